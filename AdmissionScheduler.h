@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstdint>
+
+// Capacity of the shared admission state. Fixed because it lives in a named section.
+const uint32_t ADMISSION_MAX_WAITERS = 1024;
+const uint32_t ADMISSION_MAX_FLOWS = 256;
+const uint32_t ADMISSION_MAX_IN_FLIGHT = 64;
+
+// How often waiters check the tables for launchers that died without cleaning up.
+const uint64_t ADMISSION_REAP_INTERVAL_MS = 5000;
+
+// A launcher process. The creation time tells a reused process ID apart.
+struct AdmissionOwner {
+    uint32_t processId;
+    uint64_t creationTime;
+};
+
+inline bool operator==(const AdmissionOwner& a, const AdmissionOwner& b) {
+    return a.processId == b.processId && a.creationTime == b.creationTime;
+}
+
+// Admission state shared by every ServiceUIClone process. Plain data only, so
+// the scheduling logic below does not depend on the platform.
+struct AdmissionState {
+    uint32_t initialized;
+    uint32_t maxInFlight;           // 0 = unlimited.
+    double ratePerSecond;           // Token refill rate; 0 = unlimited.
+    double burst;                   // Bucket capacity.
+    double tokens;
+    uint64_t lastRefillMs;
+    uint64_t lastReapMs;
+    double virtualTime;             // WFQ virtual clock: finish tag of the last admission.
+
+    uint32_t inFlightCount;
+    AdmissionOwner inFlightOwners[ADMISSION_MAX_IN_FLIGHT];
+
+    struct Flow {
+        uint32_t used;
+        uint32_t key;               // Hash of the caller, see LaunchFlowKey.
+        double lastFinish;
+    } flows[ADMISSION_MAX_FLOWS];
+
+    struct Waiter {
+        uint32_t used;
+        uint32_t flowKey;
+        AdmissionOwner owner;
+        double finishTag;
+        uint64_t enqueuedMs;
+    } waiters[ADMISSION_MAX_WAITERS];
+    uint32_t queueDepth;
+
+    // Metrics.
+    uint32_t maxQueueDepth;
+    uint64_t admitted;
+    uint64_t totalWaitMs;
+    uint64_t maxWaitMs;
+    uint64_t queueFullWaits;        // Enqueue attempts that found the queue full.
+};
+
+// Scheduling decisions over AdmissionState: a token bucket for the launch rate,
+// a cap on concurrent in-flight launches and weighted fair queueing between
+// flows (callers). Callers serialize access to the state.
+class AdmissionScheduler {
+public:
+    static void Configure(AdmissionState& state, uint32_t maxInFlight, double ratePerSecond, uint64_t nowMs) {
+        state.maxInFlight = maxInFlight < ADMISSION_MAX_IN_FLIGHT ? maxInFlight : ADMISSION_MAX_IN_FLIGHT;
+        state.ratePerSecond = ratePerSecond;
+        state.burst = ratePerSecond > 1.0 ? ratePerSecond : 1.0;
+        state.tokens = state.burst;
+        state.lastRefillMs = nowMs;
+        state.lastReapMs = nowMs;
+        state.initialized = 1;
+    }
+
+    // Queues a request; a larger weight gives the flow a larger share.
+    // Returns the waiter slot, or -1 if the queue is full.
+    static int Enqueue(AdmissionState& state, const AdmissionOwner& owner, uint32_t flowKey, double weight, uint64_t nowMs) {
+        int slot = FindFree(state.waiters, ADMISSION_MAX_WAITERS);
+        if (slot < 0) {
+            ++state.queueFullWaits;
+            return -1;
+        }
+        AdmissionState::Flow* flow = FindFlow(state, flowKey);
+        double start = state.virtualTime;
+        if (flow && flow->lastFinish > start)
+            start = flow->lastFinish;
+        double finish = start + 1.0 / (weight > 0.0 ? weight : 1.0);
+        if (flow)
+            flow->lastFinish = finish;
+
+        AdmissionState::Waiter& waiter = state.waiters[slot];
+        waiter.used = 1;
+        waiter.flowKey = flowKey;
+        waiter.owner = owner;
+        waiter.finishTag = finish;
+        waiter.enqueuedMs = nowMs;
+        ++state.queueDepth;
+        if (state.queueDepth > state.maxQueueDepth)
+            state.maxQueueDepth = state.queueDepth;
+        return slot;
+    }
+
+    // True if a token and an in-flight slot are available.
+    static bool HasCapacity(AdmissionState& state, uint64_t nowMs) {
+        Refill(state, nowMs);
+        if (state.maxInFlight && state.inFlightCount >= state.maxInFlight)
+            return false;
+        return state.ratePerSecond <= 0.0 || state.tokens >= 1.0;
+    }
+
+    // Admits the waiter if it has the smallest finish tag and both a token and
+    // an in-flight slot are available.
+    static bool TryAdmit(AdmissionState& state, int slot, uint64_t nowMs) {
+        if (!HasCapacity(state, nowMs) || Head(state) != slot)
+            return false;
+
+        AdmissionState::Waiter& waiter = state.waiters[slot];
+        uint64_t waitedMs = nowMs - waiter.enqueuedMs;
+        state.virtualTime = waiter.finishTag;
+        if (state.ratePerSecond > 0.0)
+            state.tokens -= 1.0;
+        if (state.inFlightCount < ADMISSION_MAX_IN_FLIGHT)
+            state.inFlightOwners[state.inFlightCount++] = waiter.owner;
+        Remove(state, slot);
+
+        ++state.admitted;
+        state.totalWaitMs += waitedMs;
+        if (waitedMs > state.maxWaitMs)
+            state.maxWaitMs = waitedMs;
+        return true;
+    }
+
+    // How long a waiter should sleep before retrying if nothing wakes it first.
+    static uint64_t RetryDelayMs(const AdmissionState& state) {
+        if (state.ratePerSecond > 0.0 && state.tokens < 1.0)
+            return static_cast<uint64_t>((1.0 - state.tokens) * 1000.0 / state.ratePerSecond) + 1;
+        return ADMISSION_REAP_INTERVAL_MS;
+    }
+
+    // For a waiter that TryAdmit turned down: how long to sleep before retrying
+    // unless woken first. Only the head times its retry by the next token; the
+    // others sleep until they become the head, since whoever changes the head (an
+    // admission or a release) wakes the new one. If capacity is free, the head
+    // missed its wakeup, so wake is set to its slot; otherwise wake is -1.
+    static uint64_t WaitMs(AdmissionState& state, int slot, uint64_t nowMs, int& wake) {
+        int head = Head(state);
+        wake = head != slot && HasCapacity(state, nowMs) ? head : -1;
+        return head == slot ? RetryDelayMs(state) : ADMISSION_REAP_INTERVAL_MS;
+    }
+
+    // Frees the in-flight slot held by owner.
+    static void Release(AdmissionState& state, const AdmissionOwner& owner) {
+        for (uint32_t i = 0; i < state.inFlightCount; ++i) {
+            if (state.inFlightOwners[i] == owner) {
+                state.inFlightOwners[i] = state.inFlightOwners[--state.inFlightCount];
+                return;
+            }
+        }
+    }
+
+    static void Remove(AdmissionState& state, int slot) {
+        if (slot >= 0 && state.waiters[slot].used) {
+            state.waiters[slot].used = 0;
+            --state.queueDepth;
+        }
+    }
+
+    // The slot of the waiter to admit next, or -1 if nobody is waiting.
+    // Smallest finish tag first; ties go to the longest waiter. After TryAdmit
+    // or Release succeeds, the caller wakes this waiter even if it cannot be
+    // admitted yet, so that it starts timing its retry (see WaitMs).
+    static int Head(const AdmissionState& state) {
+        int head = -1;
+        for (uint32_t i = 0; i < ADMISSION_MAX_WAITERS; ++i) {
+            const AdmissionState::Waiter& w = state.waiters[i];
+            if (!w.used)
+                continue;
+            if (head < 0 || w.finishTag < state.waiters[head].finishTag ||
+                (w.finishTag == state.waiters[head].finishTag && w.enqueuedMs < state.waiters[head].enqueuedMs))
+                head = static_cast<int>(i);
+        }
+        return head;
+    }
+
+    static bool ReapDue(const AdmissionState& state, uint64_t nowMs) {
+        return nowMs - state.lastReapMs >= ADMISSION_REAP_INTERVAL_MS;
+    }
+
+    // Drops waiters and in-flight slots whose owning process has died.
+    // Checking every owner is costly, so callers do it only when ReapDue() says
+    // so or when a dead lock owner has just been detected.
+    template <typename IsAlive>
+    static void Reap(AdmissionState& state, IsAlive isAlive, uint64_t nowMs) {
+        state.lastReapMs = nowMs;
+        for (uint32_t i = 0; i < ADMISSION_MAX_WAITERS; ++i) {
+            if (state.waiters[i].used && !isAlive(state.waiters[i].owner))
+                Remove(state, static_cast<int>(i));
+        }
+        for (uint32_t i = 0; i < state.inFlightCount;) {
+            if (!isAlive(state.inFlightOwners[i]))
+                state.inFlightOwners[i] = state.inFlightOwners[--state.inFlightCount];
+            else
+                ++i;
+        }
+    }
+
+private:
+    static void Refill(AdmissionState& state, uint64_t nowMs) {
+        if (state.ratePerSecond <= 0.0 || nowMs <= state.lastRefillMs)
+            return;
+        state.tokens += (nowMs - state.lastRefillMs) * state.ratePerSecond / 1000.0;
+        if (state.tokens > state.burst)
+            state.tokens = state.burst;
+        state.lastRefillMs = nowMs;
+    }
+
+    // Finds the flow for key, reusing an idle flow if the table is full.
+    static AdmissionState::Flow* FindFlow(AdmissionState& state, uint32_t key) {
+        AdmissionState::Flow* idle = nullptr;
+        for (uint32_t i = 0; i < ADMISSION_MAX_FLOWS; ++i) {
+            AdmissionState::Flow& flow = state.flows[i];
+            if (flow.used && flow.key == key)
+                return &flow;
+            if (!idle && (!flow.used || flow.lastFinish <= state.virtualTime))
+                idle = &flow;
+        }
+        if (idle) {
+            idle->used = 1;
+            idle->key = key;
+            idle->lastFinish = state.virtualTime;
+        }
+        return idle;
+    }
+
+    template <typename T>
+    static int FindFree(const T* items, uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!items[i].used)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+};
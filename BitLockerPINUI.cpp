@@ -8,8 +8,18 @@
 #include <iomanip>
 #include <string>
 #include <iostream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
 
 #include "resource.h"  // Defines IDI_BITLOCKERICON
+#include "Trace.h"
+#include "BitLockerStatus.h"
 
 #pragma comment(lib, "wbemuuid.lib")
 
@@ -23,17 +33,33 @@
 #define IDC_BUTTON_SETPIN  1201
 #define IDC_BUTTON_CANCEL  1202
 #define IDC_STATIC_ICON    1301
+#define IDC_LABEL_STATUS   1401
+#define IDC_LABEL_PREPARE  1402
+
+// Posted by the BitLocker status snapshot whenever its contents change.
+#define WM_APP_BITLOCKER_STATUS  (WM_APP + 1)
+// Posted when the background "Set PIN" preparation has finished.
+#define WM_APP_PIN_PREPARED      (WM_APP + 2)
+
+// Win32_EncryptableVolume KeyProtectorType values. The same values are passed to
+// AddKeyProtector and reported by GetKeyProtectorType.
+#define KEY_PROTECTOR_TPM_AND_PIN           4
 
 // Global font handles.
 HFONT g_hFontNormal = nullptr;
 HFONT g_hFontHeading = nullptr;
 
+// Set by /cold: skip the background preparation so every "Set PIN" takes the cold
+// path, for comparing its latency with the prepared path.
+bool g_forceCold = false;
+
 //
 // LogMessage: Writes a message with a timestamp to a log file.
 // The log file is written to C:\Temp\BitLockerPINUI.log (ensure the directory exists)
 //
 void LogMessage(const std::wstring &msg)
 {
+    TraceInstant("LogMessage");
     try {
         std::wofstream logFile(L"C:\\Temp\\BitLockerPINUI.log", std::ios::app);
         if (logFile.is_open())
@@ -89,6 +115,23 @@ std::wstring Trim(const std::wstring &str)
     return str.substr(start, end - start + 1);
 }
 
+//
+// HasSwitch: Returns true if the command line contains the switch (e.g. L"cold")
+// as "/name" or "-name", in any case.
+//
+bool HasSwitch(const std::wstring& commandLine, const std::wstring& name)
+{
+    std::wistringstream tokens(commandLine);
+    std::wstring token;
+    while (tokens >> token)
+    {
+        if (token.size() == name.size() + 1 && (token[0] == L'/' || token[0] == L'-') &&
+            _wcsicmp(token.c_str() + 1, name.c_str()) == 0)
+            return true;
+    }
+    return false;
+}
+
 //
 // ValidatePIN: Returns true if the PIN is numeric and between 8 and 20 characters.
 //
@@ -105,48 +148,46 @@ bool ValidatePIN(const std::wstring &pin)
 }
 
 //
-// SetBitLockerPinWMI: Uses WMI to call AddKeyProtector on drive C:
-// TPM+PIN is represented by KeyProtectorType = 2.
-// Returns true on success; false otherwise. The actual PIN is not logged.
+// InitializeComSecurity: Sets the process-wide COM security once at startup.
+// Must run before the first WMI call from any thread.
 //
-bool SetBitLockerPinWMI(const std::wstring& pin)
+bool InitializeComSecurity()
 {
-    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
-    if (FAILED(hr))
-    {
-        LogMessage(L"CoInitializeEx failed.");
-        return false;
-    }
-
-    hr = CoInitializeSecurity(nullptr, -1, nullptr, nullptr,
-                              RPC_C_AUTHN_LEVEL_DEFAULT, RPC_C_IMP_LEVEL_IMPERSONATE,
-                              nullptr, EOAC_NONE, nullptr);
-    if (FAILED(hr))
+    HRESULT hr = CoInitializeSecurity(nullptr, -1, nullptr, nullptr,
+                                      RPC_C_AUTHN_LEVEL_DEFAULT, RPC_C_IMP_LEVEL_IMPERSONATE,
+                                      nullptr, EOAC_NONE, nullptr);
+    if (FAILED(hr) && hr != RPC_E_TOO_LATE)
     {
         LogMessage(L"CoInitializeSecurity failed.");
-        CoUninitialize();
         return false;
     }
+    return true;
+}
 
+//
+// ConnectWmiNamespace: Connects to a WMI namespace and sets the proxy blanket.
+// The calling thread must already be in the MTA.
+//
+HRESULT ConnectWmiNamespace(LPCWSTR wmiNamespace, IWbemServices** ppSvc)
+{
+    TraceSpan span("ConnectWmiNamespace");
+    *ppSvc = nullptr;
     IWbemLocator* pLoc = nullptr;
-    hr = CoCreateInstance(CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER,
-                          IID_IWbemLocator, (LPVOID *)&pLoc);
+    HRESULT hr = CoCreateInstance(CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER,
+                                  IID_IWbemLocator, (LPVOID *)&pLoc);
     if (FAILED(hr))
     {
         LogMessage(L"Failed to create IWbemLocator object.");
-        CoUninitialize();
-        return false;
+        return hr;
     }
 
     IWbemServices* pSvc = nullptr;
-    hr = pLoc->ConnectServer(_bstr_t(L"ROOT\\CIMV2\\Security\\MicrosoftVolumeEncryption"),
-                              nullptr, nullptr, 0, 0, nullptr, 0, &pSvc);
+    hr = pLoc->ConnectServer(_bstr_t(wmiNamespace), nullptr, nullptr, 0, 0, nullptr, 0, &pSvc);
+    pLoc->Release();
     if (FAILED(hr))
     {
         LogMessage(L"Could not connect to WMI namespace.");
-        pLoc->Release();
-        CoUninitialize();
-        return false;
+        return hr;
     }
 
     hr = CoSetProxyBlanket(pSvc, RPC_C_AUTHN_WINNT, RPC_C_AUTHZ_NONE,
@@ -156,7 +197,357 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
     {
         LogMessage(L"CoSetProxyBlanket failed.");
         pSvc->Release();
-        pLoc->Release();
+        return hr;
+    }
+
+    *ppSvc = pSvc;
+    return S_OK;
+}
+
+//
+// ConnectBitLockerNamespace: Connects to the BitLocker WMI namespace.
+//
+HRESULT ConnectBitLockerNamespace(IWbemServices** ppSvc)
+{
+    return ConnectWmiNamespace(L"ROOT\\CIMV2\\Security\\MicrosoftVolumeEncryption", ppSvc);
+}
+
+//
+// GetStringProperty / GetUIntProperty / GetBoolProperty: Read a property of a WMI object.
+// Return false if the property is missing or null.
+//
+bool GetStringProperty(IWbemClassObject* pObj, LPCWSTR name, std::wstring& value)
+{
+    VARIANT var;
+    VariantInit(&var);
+    bool ok = SUCCEEDED(pObj->Get(name, 0, &var, nullptr, nullptr)) && var.vt == VT_BSTR;
+    if (ok)
+        value = var.bstrVal;
+    VariantClear(&var);
+    return ok;
+}
+
+bool GetUIntProperty(IWbemClassObject* pObj, LPCWSTR name, UINT& value)
+{
+    VARIANT var;
+    VariantInit(&var);
+    bool ok = SUCCEEDED(pObj->Get(name, 0, &var, nullptr, nullptr)) &&
+              SUCCEEDED(VariantChangeType(&var, &var, 0, VT_UI4));
+    if (ok)
+        value = var.ulVal;
+    VariantClear(&var);
+    return ok;
+}
+
+bool GetBoolProperty(IWbemClassObject* pObj, LPCWSTR name, bool& value)
+{
+    VARIANT var;
+    VariantInit(&var);
+    bool ok = SUCCEEDED(pObj->Get(name, 0, &var, nullptr, nullptr)) && var.vt == VT_BOOL;
+    if (ok)
+        value = var.boolVal != VARIANT_FALSE;
+    VariantClear(&var);
+    return ok;
+}
+
+//
+// ExecVolumeMethod: Calls a Win32_EncryptableVolume method on the volume at path.
+// pInParams may be null. Returns false unless the call and its ReturnValue succeed.
+//
+bool ExecVolumeMethod(IWbemServices* pSvc, const std::wstring& path, LPCWSTR method,
+                      IWbemClassObject* pInParams, IWbemClassObject** ppOutParams)
+{
+    *ppOutParams = nullptr;
+    HRESULT hr = pSvc->ExecMethod(_bstr_t(path.c_str()), _bstr_t(method), 0, nullptr,
+                                  pInParams, ppOutParams, nullptr);
+    UINT returnValue = 1;
+    if (FAILED(hr) || !*ppOutParams ||
+        !GetUIntProperty(*ppOutParams, L"ReturnValue", returnValue) || returnValue != 0)
+    {
+        if (*ppOutParams)
+        {
+            (*ppOutParams)->Release();
+            *ppOutParams = nullptr;
+        }
+        return false;
+    }
+    return true;
+}
+
+//
+// ReadVolumeStatus: Reads protection status, conversion progress and protector types
+// for one Win32_EncryptableVolume instance.
+//
+bool ReadVolumeStatus(IWbemServices* pSvc, IWbemClassObject* pVolume, VolumeStatus& status)
+{
+    TraceSpan span("ReadVolumeStatus");
+    status = VolumeStatus();
+    if (!GetStringProperty(pVolume, L"DeviceID", status.deviceId) ||
+        !GetStringProperty(pVolume, L"__RELPATH", status.path))
+        return false;
+    GetStringProperty(pVolume, L"DriveLetter", status.driveLetter);
+    GetUIntProperty(pVolume, L"ProtectionStatus", status.protectionStatus);
+
+    IWbemClassObject* pOut = nullptr;
+    if (ExecVolumeMethod(pSvc, status.path, L"GetConversionStatus", nullptr, &pOut))
+    {
+        GetUIntProperty(pOut, L"ConversionStatus", status.conversionStatus);
+        GetUIntProperty(pOut, L"EncryptionPercentage", status.encryptionPercentage);
+        pOut->Release();
+    }
+
+    if (!ExecVolumeMethod(pSvc, status.path, L"GetKeyProtectors", nullptr, &pOut))
+        return true;
+    VARIANT varIds;
+    VariantInit(&varIds);
+    if (SUCCEEDED(pOut->Get(L"VolumeKeyProtectorID", 0, &varIds, nullptr, nullptr)) &&
+        varIds.vt == (VT_ARRAY | VT_BSTR))
+    {
+        IWbemClassObject* pClass = nullptr;
+        IWbemClassObject* pInDef = nullptr;
+        if (SUCCEEDED(pSvc->GetObject(_bstr_t(L"Win32_EncryptableVolume"), 0, nullptr, &pClass, nullptr)))
+        {
+            pClass->GetMethod(L"GetKeyProtectorType", 0, &pInDef, nullptr);
+            pClass->Release();
+        }
+        LONG lower = 0, upper = -1;
+        SafeArrayGetLBound(varIds.parray, 1, &lower);
+        SafeArrayGetUBound(varIds.parray, 1, &upper);
+        for (LONG i = lower; pInDef && i <= upper; ++i)
+        {
+            BSTR id = nullptr;
+            if (FAILED(SafeArrayGetElement(varIds.parray, &i, &id)))
+                continue;
+            IWbemClassObject* pIn = nullptr;
+            if (SUCCEEDED(pInDef->SpawnInstance(0, &pIn)))
+            {
+                VARIANT varId;
+                VariantInit(&varId);
+                varId.vt = VT_BSTR;
+                varId.bstrVal = id;
+                id = nullptr;
+                pIn->Put(L"VolumeKeyProtectorID", 0, &varId, 0);
+                VariantClear(&varId);
+
+                IWbemClassObject* pTypeOut = nullptr;
+                UINT type = 0;
+                if (ExecVolumeMethod(pSvc, status.path, L"GetKeyProtectorType", pIn, &pTypeOut))
+                {
+                    if (GetUIntProperty(pTypeOut, L"KeyProtectorType", type))
+                        status.protectorTypes.push_back(type);
+                    pTypeOut->Release();
+                }
+                pIn->Release();
+            }
+            SysFreeString(id);
+        }
+        if (pInDef)
+            pInDef->Release();
+    }
+    VariantClear(&varIds);
+    pOut->Release();
+    return true;
+}
+
+//
+// VolumeEventSink: Receives __InstanceModificationEvent notifications for
+// Win32_EncryptableVolume and passes the changed volume's path on.
+// Indicate runs on a WMI thread, so onChange must only queue work.
+//
+class VolumeEventSink : public IWbemObjectSink
+{
+public:
+    explicit VolumeEventSink(std::function<void(const std::wstring&)> onChange) : onChange(std::move(onChange)) {}
+
+    ULONG STDMETHODCALLTYPE AddRef() override { return InterlockedIncrement(&refCount); }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        LONG count = InterlockedDecrement(&refCount);
+        if (count == 0)
+            delete this;
+        return count;
+    }
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv) override
+    {
+        if (riid == IID_IUnknown || riid == IID_IWbemObjectSink)
+        {
+            *ppv = static_cast<IWbemObjectSink*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = nullptr;
+        return E_NOINTERFACE;
+    }
+    HRESULT STDMETHODCALLTYPE Indicate(LONG count, IWbemClassObject** objects) override
+    {
+        for (LONG i = 0; i < count; ++i)
+        {
+            VARIANT varTarget;
+            VariantInit(&varTarget);
+            if (SUCCEEDED(objects[i]->Get(L"TargetInstance", 0, &varTarget, nullptr, nullptr)) &&
+                varTarget.vt == VT_UNKNOWN && varTarget.punkVal)
+            {
+                IWbemClassObject* pTarget = nullptr;
+                if (SUCCEEDED(varTarget.punkVal->QueryInterface(IID_IWbemClassObject, (void**)&pTarget)))
+                {
+                    std::wstring path;
+                    if (GetStringProperty(pTarget, L"__RELPATH", path))
+                        onChange(path);
+                    pTarget->Release();
+                }
+            }
+            VariantClear(&varTarget);
+        }
+        return WBEM_S_NO_ERROR;
+    }
+    HRESULT STDMETHODCALLTYPE SetStatus(LONG, HRESULT, BSTR, IWbemClassObject*) override
+    {
+        return WBEM_S_NO_ERROR;
+    }
+
+private:
+    LONG refCount = 1;
+    std::function<void(const std::wstring&)> onChange;
+};
+
+//
+// WmiVolumeStatusSource: Reads Win32_EncryptableVolume through WMI for the status
+// snapshot, on the snapshot's worker thread (which joins the MTA in Open).
+//
+class WmiVolumeStatusSource : public VolumeStatusSource
+{
+public:
+    bool Open() override
+    {
+        if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED)))
+        {
+            LogMessage(L"Status snapshot: CoInitializeEx failed.");
+            return false;
+        }
+        comInitialized = true;
+        if (FAILED(ConnectBitLockerNamespace(&pSvc)))
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() override
+    {
+        if (pSink)
+        {
+            pSvc->CancelAsyncCall(pSink);
+            pSink->Release();
+            pSink = nullptr;
+        }
+        if (pSvc)
+        {
+            pSvc->Release();
+            pSvc = nullptr;
+        }
+        if (comInitialized)
+        {
+            CoUninitialize();
+            comInitialized = false;
+        }
+    }
+
+    bool EnumerateVolumes(const std::function<bool(const VolumeStatus&)>& onVolume) override
+    {
+        IEnumWbemClassObject* pEnumerator = nullptr;
+        HRESULT hr = pSvc->ExecQuery(_bstr_t(L"WQL"), _bstr_t(L"SELECT * FROM Win32_EncryptableVolume"),
+                                     WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY,
+                                     nullptr, &pEnumerator);
+        if (FAILED(hr))
+            return false;
+        IWbemClassObject* pVolume = nullptr;
+        ULONG uReturn = 0;
+        bool more = true;
+        while (more && SUCCEEDED(pEnumerator->Next(WBEM_INFINITE, 1, &pVolume, &uReturn)) && uReturn != 0)
+        {
+            VolumeStatus status;
+            if (ReadVolumeStatus(pSvc, pVolume, status))
+                more = onVolume(status);
+            pVolume->Release();
+        }
+        pEnumerator->Release();
+        return true;
+    }
+
+    bool ReadVolume(const std::wstring& path, VolumeStatus& status) override
+    {
+        IWbemClassObject* pObj = nullptr;
+        if (FAILED(pSvc->GetObject(_bstr_t(path.c_str()), 0, nullptr, &pObj, nullptr)))
+            return false;
+        bool ok = ReadVolumeStatus(pSvc, pObj, status);
+        pObj->Release();
+        return ok;
+    }
+
+    bool Subscribe(std::function<void(const std::wstring&)> onChange) override
+    {
+        VolumeEventSink* pNewSink = new VolumeEventSink(std::move(onChange));
+        HRESULT hr = pSvc->ExecNotificationQueryAsync(_bstr_t(L"WQL"),
+            _bstr_t(L"SELECT * FROM __InstanceModificationEvent WITHIN 5 "
+                    L"WHERE TargetInstance ISA 'Win32_EncryptableVolume'"),
+            WBEM_FLAG_SEND_STATUS, nullptr, pNewSink);
+        if (FAILED(hr))
+        {
+            pNewSink->Release();
+            return false;
+        }
+        pSink = pNewSink;
+        return true;
+    }
+
+private:
+    IWbemServices* pSvc = nullptr;
+    VolumeEventSink* pSink = nullptr;
+    bool comInitialized = false;
+};
+
+BitLockerStatusSnapshot g_bitLockerStatus;
+
+//
+// DescribeVolumeStatus: Builds the status line shown under the buttons.
+//
+std::wstring DescribeVolumeStatus(const std::wstring& driveLetter)
+{
+    VolumeStatus status;
+    if (!g_bitLockerStatus.Lookup(driveLetter, status))
+    {
+        if (g_bitLockerStatus.LoadFailed())
+            return L"BitLocker status is unavailable.";
+        return g_bitLockerStatus.IsLoaded() ? L"No BitLocker volume found for " + driveLetter
+                                            : L"Checking BitLocker status...";
+    }
+    std::wstring text = L"Protection ";
+    text += status.protectionStatus == 1 ? L"on" : (status.protectionStatus == 0 ? L"off" : L"unknown");
+    text += L", " + std::to_wstring(status.encryptionPercentage) + L"% encrypted. TPM+PIN: ";
+    text += status.HasProtector(KEY_PROTECTOR_TPM_AND_PIN) ? L"set." : L"not set.";
+    return text;
+}
+
+//
+// SetBitLockerPinWMI: Uses WMI to call AddKeyProtector on drive C:
+// TPM+PIN is represented by KeyProtectorType = KEY_PROTECTOR_TPM_AND_PIN.
+// Returns true on success; false otherwise. The actual PIN is not logged.
+//
+bool SetBitLockerPinWMI(const std::wstring& pin)
+{
+    TraceSpan span("SetBitLockerPinWMI");
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    if (FAILED(hr))
+    {
+        LogMessage(L"CoInitializeEx failed.");
+        return false;
+    }
+
+    IWbemServices* pSvc = nullptr;
+    hr = ConnectBitLockerNamespace(&pSvc);
+    if (FAILED(hr))
+    {
         CoUninitialize();
         return false;
     }
@@ -171,7 +562,6 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
     {
         LogMessage(L"Query for Win32_EncryptableVolume failed.");
         pSvc->Release();
-        pLoc->Release();
         CoUninitialize();
         return false;
     }
@@ -184,7 +574,6 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
         LogMessage(L"No BitLocker volume found for drive C:.");
         if (pEnumerator) pEnumerator->Release();
         pSvc->Release();
-        pLoc->Release();
         CoUninitialize();
         return false;
     }
@@ -199,7 +588,6 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
         LogMessage(L"Failed to get volume __PATH.");
         pVolume->Release();
         pSvc->Release();
-        pLoc->Release();
         CoUninitialize();
         return false;
     }
@@ -213,7 +601,6 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
         VariantClear(&varPath);
         pVolume->Release();
         pSvc->Release();
-        pLoc->Release();
         CoUninitialize();
         return false;
     }
@@ -228,7 +615,6 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
         VariantClear(&varPath);
         pVolume->Release();
         pSvc->Release();
-        pLoc->Release();
         CoUninitialize();
         return false;
     }
@@ -242,16 +628,15 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
         VariantClear(&varPath);
         pVolume->Release();
         pSvc->Release();
-        pLoc->Release();
         CoUninitialize();
         return false;
     }
 
-    // Set KeyProtectorType = 2 (TPM+PIN)
+    // Set KeyProtectorType = KEY_PROTECTOR_TPM_AND_PIN
     VARIANT varProtectorType;
     VariantInit(&varProtectorType);
     varProtectorType.vt = VT_UINT;
-    varProtectorType.uintVal = 2;
+    varProtectorType.uintVal = KEY_PROTECTOR_TPM_AND_PIN;
     hr = pInParams->Put(L"KeyProtectorType", 0, &varProtectorType, 0);
     VariantClear(&varProtectorType);
     if (FAILED(hr))
@@ -261,7 +646,6 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
         VariantClear(&varPath);
         pVolume->Release();
         pSvc->Release();
-        pLoc->Release();
         CoUninitialize();
         return false;
     }
@@ -280,7 +664,6 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
         VariantClear(&varPath);
         pVolume->Release();
         pSvc->Release();
-        pLoc->Release();
         CoUninitialize();
         return false;
     }
@@ -288,7 +671,10 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
     // Execute the AddKeyProtector method.
     IWbemClassObject* pOutParams = nullptr;
     BSTR methodName = SysAllocString(L"AddKeyProtector");
-    hr = pSvc->ExecMethod(varPath.bstrVal, methodName, 0, nullptr, pInParams, &pOutParams, nullptr);
+    {
+        TraceSpan execSpan("ExecMethod AddKeyProtector");
+        hr = pSvc->ExecMethod(varPath.bstrVal, methodName, 0, nullptr, pInParams, &pOutParams, nullptr);
+    }
     SysFreeString(methodName);
     bool success = false;
     if (SUCCEEDED(hr))
@@ -299,6 +685,7 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
         if (SUCCEEDED(hr) && varReturn.vt == VT_I4 && varReturn.intVal == 0)
         {
             success = true;
+            g_bitLockerStatus.RequestRefresh(varPath.bstrVal);
         }
         VariantClear(&varReturn);
         pOutParams->Release();
@@ -313,22 +700,278 @@ bool SetBitLockerPinWMI(const std::wstring& pin)
     VariantClear(&varPath);
     pVolume->Release();
     pSvc->Release();
-    pLoc->Release();
     CoUninitialize();
     return success;
 }
 
+//
+// PinPreparation: Does everything "Set PIN" needs except the PIN itself on a background
+// thread started at window creation: connects to the namespace, locates the volume,
+// checks that TPM-based protectors are allowed and spawns the AddKeyProtector input
+// parameters. Clicking then only sets the PIN and calls ExecMethod.
+// Start, Wait, AddKeyProtector and Stop are called from the UI thread only.
+//
+class PinPreparation
+{
+public:
+    ~PinPreparation() { Stop(); }
+
+    void Start(HWND hwndNotify, UINT notifyMsg)
+    {
+        if (worker.joinable())
+            return;
+        hwnd = hwndNotify;
+        msg = notifyMsg;
+        worker = std::thread(&PinPreparation::Run, this);
+    }
+
+    // Waits for the preparation to finish. Returns true if it succeeded.
+    bool Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!done && !worker.joinable())
+            return false;
+        finished.wait(lock, [this] { return done; });
+        return pInParams != nullptr;
+    }
+
+    bool IsDone() const { std::lock_guard<std::mutex> lock(mutex); return done; }
+
+    // Reason the preparation failed; empty on success.
+    std::wstring Error() const { std::lock_guard<std::mutex> lock(mutex); return error; }
+
+    // Sets the PIN on the prepared parameters and calls AddKeyProtector.
+    // The parameters are re-spawned afterwards so the PIN does not linger.
+    bool AddKeyProtector(const std::wstring& pin)
+    {
+        if (!Wait())
+            return false;
+
+        VARIANT varPin;
+        VariantInit(&varPin);
+        varPin.vt = VT_BSTR;
+        varPin.bstrVal = SysAllocString(pin.c_str());
+        HRESULT hr = pInParams->Put(L"Pin", 0, &varPin, 0);
+        VariantClear(&varPin);
+        if (FAILED(hr))
+        {
+            LogMessage(L"Failed to set Pin parameter.");
+            return false;
+        }
+
+        IWbemClassObject* pOutParams = nullptr;
+        bool success;
+        {
+            TraceSpan span("ExecMethod AddKeyProtector (prepared)");
+            success = ExecVolumeMethod(pSvc, volumePath, L"AddKeyProtector", pInParams, &pOutParams);
+        }
+        if (pOutParams)
+            pOutParams->Release();
+        if (!success)
+            LogMessage(L"ExecMethod for AddKeyProtector failed.");
+        else
+            g_bitLockerStatus.RequestRefresh(volumePath);
+
+        pInParams->Release();
+        pInParams = nullptr;
+        if (!SpawnInParams())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = L"Failed to prepare AddKeyProtector input parameters.";
+        }
+        return success;
+    }
+
+    void Stop()
+    {
+        if (worker.joinable())
+            worker.join();
+        if (pInParams)
+            pInParams->Release();
+        if (pInParamsDefinition)
+            pInParamsDefinition->Release();
+        if (pSvc)
+            pSvc->Release();
+        pInParams = pInParamsDefinition = nullptr;
+        pSvc = nullptr;
+    }
+
+private:
+    void Run()
+    {
+        TraceSpan span("PinPreparation");
+        std::wstring failure;
+        if (SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED)))
+        {
+            failure = Prepare();
+            // The objects belong to the MTA, which the UI thread keeps alive.
+            CoUninitialize();
+        }
+        else
+        {
+            failure = L"COM could not be initialized.";
+        }
+
+        if (failure.empty())
+            LogMessage(L"Set PIN preparation finished.");
+        else
+            LogMessage(L"Set PIN preparation failed: " + failure);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = failure;
+            done = true;
+        }
+        finished.notify_all();
+        PostMessage(hwnd, msg, 0, 0);
+    }
+
+    // Returns an empty string on success, otherwise the reason for the failure.
+    std::wstring Prepare()
+    {
+        std::wstring policyError = CheckTpmProtectorsAllowed();
+        if (!policyError.empty())
+            return policyError;
+
+        if (FAILED(ConnectBitLockerNamespace(&pSvc)))
+            return L"Could not connect to the BitLocker WMI namespace.";
+
+        IEnumWbemClassObject* pEnumerator = nullptr;
+        HRESULT hr = pSvc->ExecQuery(_bstr_t(L"WQL"),
+                                     _bstr_t(L"SELECT * FROM Win32_EncryptableVolume WHERE DeviceID = \"C:\""),
+                                     WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY,
+                                     nullptr, &pEnumerator);
+        if (FAILED(hr))
+            return L"Query for Win32_EncryptableVolume failed.";
+        IWbemClassObject* pVolume = nullptr;
+        ULONG uReturn = 0;
+        hr = pEnumerator->Next(WBEM_INFINITE, 1, &pVolume, &uReturn);
+        pEnumerator->Release();
+        if (FAILED(hr) || uReturn == 0)
+            return L"No BitLocker volume found for drive C:.";
+        bool havePath = GetStringProperty(pVolume, L"__PATH", volumePath);
+        pVolume->Release();
+        if (!havePath)
+            return L"Failed to get volume __PATH.";
+
+        IWbemClassObject* pClass = nullptr;
+        hr = pSvc->GetObject(_bstr_t(L"Win32_EncryptableVolume"), 0, nullptr, &pClass, nullptr);
+        if (FAILED(hr))
+            return L"Failed to get Win32_EncryptableVolume class definition.";
+        hr = pClass->GetMethod(L"AddKeyProtector", 0, &pInParamsDefinition, nullptr);
+        pClass->Release();
+        if (FAILED(hr))
+            return L"Failed to retrieve AddKeyProtector method definition.";
+
+        if (!SpawnInParams())
+            return L"Failed to prepare AddKeyProtector input parameters.";
+        return std::wstring();
+    }
+
+    // Spawns fresh input parameters with KeyProtectorType = KEY_PROTECTOR_TPM_AND_PIN already set.
+    bool SpawnInParams()
+    {
+        if (FAILED(pInParamsDefinition->SpawnInstance(0, &pInParams)))
+            return false;
+        VARIANT varProtectorType;
+        VariantInit(&varProtectorType);
+        varProtectorType.vt = VT_UINT;
+        varProtectorType.uintVal = KEY_PROTECTOR_TPM_AND_PIN;
+        HRESULT hr = pInParams->Put(L"KeyProtectorType", 0, &varProtectorType, 0);
+        VariantClear(&varProtectorType);
+        if (FAILED(hr))
+        {
+            pInParams->Release();
+            pInParams = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    // Checks BitLocker group policy and the TPM. Returns an empty string if a
+    // TPM+PIN protector can be added.
+    static std::wstring CheckTpmProtectorsAllowed()
+    {
+        // HKLM\SOFTWARE\Policies\Microsoft\FVE. Each startup mode (UseTPM, UseTPMPIN,
+        // UseTPMKey, UseTPMKeyPIN) is 0 = do not allow, 1 = require, 2 = allow.
+        // UseTPM = 0 only forbids TPM-only protectors, and is how TPM+PIN is
+        // usually enforced, so it does not stop us.
+        auto readPolicy = [](LPCTSTR name, DWORD &value) -> bool
+        {
+            DWORD size = sizeof(value);
+            return RegGetValue(HKEY_LOCAL_MACHINE, _T("SOFTWARE\\Policies\\Microsoft\\FVE"), name,
+                               RRF_RT_REG_DWORD, nullptr, &value, &size) == ERROR_SUCCESS;
+        };
+        DWORD value = 0;
+        if (readPolicy(_T("UseTPMPIN"), value) && value == 0)
+            return L"Group policy does not allow a startup PIN with the TPM.";
+        // The modes only apply when "Require additional authentication at startup"
+        // is on. Then requiring any other mode rules out TPM+PIN.
+        if (readPolicy(_T("UseAdvancedStartup"), value) && value == 1)
+        {
+            const LPCTSTR otherModes[] = { _T("UseTPM"), _T("UseTPMKey"), _T("UseTPMKeyPIN") };
+            for (LPCTSTR mode : otherModes)
+            {
+                if (readPolicy(mode, value) && value == 1)
+                    return L"Group policy requires a startup method other than a TPM and PIN.";
+            }
+        }
+
+        IWbemServices* pTpmSvc = nullptr;
+        if (FAILED(ConnectWmiNamespace(L"ROOT\\CIMV2\\Security\\MicrosoftTpm", &pTpmSvc)))
+            return L"Could not connect to the TPM WMI namespace.";
+        std::wstring result = L"No TPM was found.";
+        IEnumWbemClassObject* pEnumerator = nullptr;
+        if (SUCCEEDED(pTpmSvc->ExecQuery(_bstr_t(L"WQL"), _bstr_t(L"SELECT * FROM Win32_Tpm"),
+                                         WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY,
+                                         nullptr, &pEnumerator)))
+        {
+            IWbemClassObject* pTpm = nullptr;
+            ULONG uReturn = 0;
+            if (SUCCEEDED(pEnumerator->Next(WBEM_INFINITE, 1, &pTpm, &uReturn)) && uReturn != 0)
+            {
+                // Both are booleans; a missing value is not treated as disabled.
+                bool enabled = true, activated = true;
+                GetBoolProperty(pTpm, L"IsEnabled_InitialValue", enabled);
+                GetBoolProperty(pTpm, L"IsActivated_InitialValue", activated);
+                result = (enabled && activated) ? std::wstring() : L"The TPM is not enabled and activated.";
+                pTpm->Release();
+            }
+            pEnumerator->Release();
+        }
+        pTpmSvc->Release();
+        return result;
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable finished;
+    std::thread worker;
+    HWND hwnd = nullptr;
+    UINT msg = 0;
+    bool done = false;
+    std::wstring error;
+
+    // Written by the worker before done is set; used by the UI thread afterwards.
+    IWbemServices* pSvc = nullptr;
+    IWbemClassObject* pInParamsDefinition = nullptr;
+    IWbemClassObject* pInParams = nullptr;
+    std::wstring volumePath;
+};
+
+PinPreparation g_pinPreparation;
+
 //
 // WindowProc: Creates the modern UI with a logo, headings, PIN input fields, and buttons.
 // Performs robust input validation and calls SetBitLockerPinWMI to set the BitLocker PIN.
 //
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
-    static HWND hEditNewPin = nullptr, hEditRePin = nullptr, hIconCtrl = nullptr;
+    static HWND hEditNewPin = nullptr, hEditRePin = nullptr, hIconCtrl = nullptr, hLabelStatus = nullptr;
+    static HWND hLabelPrepare = nullptr;
     switch (uMsg)
     {
         case WM_CREATE:
         {
+            TraceSpan span("WindowProc WM_CREATE");
             HINSTANCE hInst = ((LPCREATESTRUCT)lParam)->hInstance;
             HDC hdc = GetDC(hwnd);
             int dpiY = GetDeviceCaps(hdc, LOGPIXELSY);
@@ -411,16 +1054,48 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                                               hwnd, (HMENU)IDC_BUTTON_CANCEL, hInst, nullptr);
             SendMessage(hButtonCancel, WM_SETFONT, (WPARAM)g_hFontNormal, TRUE);
 
+            // Current BitLocker status, filled in by the status snapshot.
+            hLabelStatus = CreateWindow(_T("STATIC"), _T("Checking BitLocker status..."),
+                                        WS_CHILD | WS_VISIBLE,
+                                        15, 215, 290, 20,
+                                        hwnd, (HMENU)IDC_LABEL_STATUS, hInst, nullptr);
+            SendMessage(hLabelStatus, WM_SETFONT, (WPARAM)g_hFontNormal, TRUE);
+            g_bitLockerStatus.Start(std::unique_ptr<VolumeStatusSource>(new WmiVolumeStatusSource()),
+                                    [hwnd] { PostMessage(hwnd, WM_APP_BITLOCKER_STATUS, 0, 0); });
+
+            // Preparation problems, reported as soon as the background preparation ends.
+            hLabelPrepare = CreateWindow(_T("STATIC"), _T(""),
+                                         WS_CHILD | WS_VISIBLE,
+                                         15, 237, 290, 20,
+                                         hwnd, (HMENU)IDC_LABEL_PREPARE, hInst, nullptr);
+            SendMessage(hLabelPrepare, WM_SETFONT, (WPARAM)g_hFontNormal, TRUE);
+            if (!g_forceCold)
+                g_pinPreparation.Start(hwnd, WM_APP_PIN_PREPARED);
+
             LogMessage(L"Window created and controls initialized (with logo).");
             break;
         }
 
+        case WM_APP_BITLOCKER_STATUS:
+        {
+            SetWindowText(hLabelStatus, DescribeVolumeStatus(L"C:").c_str());
+            break;
+        }
+
+        case WM_APP_PIN_PREPARED:
+        {
+            std::wstring error = g_pinPreparation.Error();
+            SetWindowText(hLabelPrepare, error.empty() ? L"" : (L"Warning: " + error).c_str());
+            break;
+        }
+
         case WM_COMMAND:
         {
             switch (LOWORD(wParam))
             {
                 case IDC_BUTTON_SETPIN:
                 {
+                    TraceSpan span("WindowProc Set PIN");
                     const int bufferSize = 256;
                     TCHAR newPinBuf[bufferSize] = { 0 };
                     TCHAR rePinBuf[bufferSize] = { 0 };
@@ -452,7 +1127,17 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                         return 0;
                     }
 
-                    if (SetBitLockerPinWMI(pin1)) {
+                    // Use the background preparation if it succeeded; otherwise do it all now.
+                    // With /cold there is no preparation, so Wait() returns false at once.
+                    auto clickStart = std::chrono::steady_clock::now();
+                    bool prepared = g_pinPreparation.Wait();
+                    bool success = prepared ? g_pinPreparation.AddKeyProtector(pin1) : SetBitLockerPinWMI(pin1);
+                    auto latencyMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - clickStart).count();
+                    LogMessage(L"Set PIN click-to-result latency: " + std::to_wstring(latencyMs) +
+                               (prepared ? L" ms (prepared)." : (g_forceCold ? L" ms (cold, forced by /cold)." : L" ms (cold).")));
+
+                    if (success) {
                         MessageBox(hwnd, _T("BitLocker PIN set successfully."), _T("Success"), MB_ICONINFORMATION);
                         LogMessage(L"BitLocker PIN set successfully.");
                     }
@@ -477,6 +1162,8 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         case WM_DESTROY:
         {
             LogMessage(L"Window destroyed. Exiting application.");
+            g_bitLockerStatus.Stop();
+            g_pinPreparation.Stop();
             if (g_hFontNormal)
             {
                 DeleteObject(g_hFontNormal);
@@ -497,9 +1184,25 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     return 0;
 }
 
-int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR, int nCmdShow)
+int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR lpCmdLine, int nCmdShow)
 {
+    TraceSession traceSession("BitLockerPINUI", "bitlocker");
     LogMessage(L"Application started.");
+    g_forceCold = HasSwitch(lpCmdLine, L"cold");
+    if (g_forceCold)
+        LogMessage(L"/cold: background preparation disabled; Set PIN uses the cold path.");
+
+    // COM is initialized once for the process; WMI calls on every thread rely on it.
+    if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED)))
+    {
+        LogMessage(L"Error: CoInitializeEx failed.");
+        return 1;
+    }
+    if (!InitializeComSecurity())
+    {
+        CoUninitialize();
+        return 1;
+    }
 
     const TCHAR CLASS_NAME[] = _T("BitLockerPINUIClass");
     WNDCLASS wc = {};
@@ -512,6 +1215,7 @@ int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR, int nCmdShow)
     {
         MessageBox(nullptr, _T("Window Registration Failed!"), _T("Error"), MB_ICONERROR);
         LogMessage(L"Error: Window registration failed.");
+        CoUninitialize();
         return 1;
     }
     LogMessage(L"Window class registered successfully.");
@@ -520,7 +1224,7 @@ int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR, int nCmdShow)
         CLASS_NAME,
         _T("BitLocker startup PIN (C:)"),
         WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU,
-        CW_USEDEFAULT, CW_USEDEFAULT, 330, 250,
+        CW_USEDEFAULT, CW_USEDEFAULT, 330, 305,
         nullptr, nullptr, hInstance, nullptr
     );
 
@@ -528,6 +1232,7 @@ int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR, int nCmdShow)
     {
         MessageBox(nullptr, _T("Window Creation Failed!"), _T("Error"), MB_ICONERROR);
         LogMessage(L"Error: Window creation failed.");
+        CoUninitialize();
         return 1;
     }
     LogMessage(L"Window created successfully.");
@@ -542,6 +1247,9 @@ int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR, int nCmdShow)
         DispatchMessage(&msg);
     }
 
+    g_bitLockerStatus.Stop();
+    g_pinPreparation.Stop();
+    CoUninitialize();
     LogMessage(L"Application exiting.");
     return (int)msg.wParam;
 }
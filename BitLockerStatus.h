@@ -0,0 +1,265 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <cwctype>
+#include "Trace.h"
+#include "Logging.h"
+
+//
+// VolumeStatus: Protection state of one BitLocker volume as last read from WMI.
+//
+struct VolumeStatus
+{
+    std::wstring deviceId;
+    std::wstring driveLetter;        // Empty for volumes without a letter.
+    std::wstring path;               // Relative WMI path, usable with ExecMethod.
+    unsigned int protectionStatus = 2;       // 0 = off, 1 = on, 2 = unknown.
+    unsigned int conversionStatus = 0;       // 0 = fully decrypted ... 1 = fully encrypted, etc.
+    unsigned int encryptionPercentage = 0;
+    std::vector<unsigned int> protectorTypes;
+
+    bool HasProtector(unsigned int type) const
+    {
+        for (unsigned int t : protectorTypes)
+        {
+            if (t == type)
+                return true;
+        }
+        return false;
+    }
+};
+
+//
+// VolumeStatusSource: Where the snapshot reads volumes from. All calls are made on
+// the snapshot's worker thread, between Open and Close. BitLockerPINUI uses WMI;
+// tests use a fake.
+//
+class VolumeStatusSource
+{
+public:
+    virtual ~VolumeStatusSource() = default;
+
+    virtual bool Open() = 0;
+    virtual void Close() = 0;
+
+    // Reads every volume, passing each to onVolume until it returns false.
+    virtual bool EnumerateVolumes(const std::function<bool(const VolumeStatus&)>& onVolume) = 0;
+
+    // Re-reads the volume at the given path.
+    virtual bool ReadVolume(const std::wstring& path, VolumeStatus& status) = 0;
+
+    // Calls onChange, from any thread, with the path of each volume reported as
+    // modified. Returns false if change notifications are unavailable.
+    virtual bool Subscribe(std::function<void(const std::wstring&)> onChange) = 0;
+};
+
+//
+// BitLockerStatusSnapshot: In-memory view of every BitLocker volume.
+// A background thread enumerates all volumes once, then keeps the view current by
+// re-reading the volumes named in change notifications. Queries never touch the source.
+//
+// WMI only reports changes to Win32_EncryptableVolume properties (such as
+// ProtectionStatus), polled every 5 seconds. Encryption progress and key protectors
+// come from method calls, so changing them raises no event. To catch those, every
+// known volume is also re-read on a slow timer (fullRefreshInterval).
+//
+class BitLockerStatusSnapshot
+{
+public:
+    explicit BitLockerStatusSnapshot(std::chrono::milliseconds fullRefreshInterval = std::chrono::seconds(60))
+        : fullRefreshInterval(fullRefreshInterval) {}
+    ~BitLockerStatusSnapshot() { Stop(); }
+
+    // Starts the background load. onChange is called on the worker thread after every
+    // change, with the snapshot locked, so it must not call back into the snapshot.
+    void Start(std::unique_ptr<VolumeStatusSource> volumeSource, std::function<void()> onChange)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (worker.joinable())
+            return;
+        source = std::move(volumeSource);
+        notify = std::move(onChange);
+        stopping = false;
+        worker = std::thread(&BitLockerStatusSnapshot::Run, this);
+    }
+
+    // Stops the worker. No change notification is made after Stop returns.
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            notify = nullptr;
+        }
+        wake.notify_all();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // Returns the cached status of the volume mounted at driveLetter (e.g. L"C:").
+    bool Lookup(const std::wstring& driveLetter, VolumeStatus& status) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : volumes)
+        {
+            if (SameLetter(entry.second.driveLetter, driveLetter))
+            {
+                status = entry.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool IsLoaded() const { std::lock_guard<std::mutex> lock(mutex); return loaded; }
+    bool LoadFailed() const { std::lock_guard<std::mutex> lock(mutex); return loadFailed; }
+
+    // Replaces the cached status of one volume.
+    void Apply(const VolumeStatus& status)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            volumes[status.deviceId] = status;
+        }
+        Notify();
+    }
+
+    // Queues a re-read of the volume at the given path.
+    void RequestRefresh(const std::wstring& volumePath)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(volumePath);
+        }
+        wake.notify_all();
+    }
+
+private:
+    static bool SameLetter(const std::wstring& a, const std::wstring& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (towupper(a[i]) != towupper(b[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool IsStopping() const { std::lock_guard<std::mutex> lock(mutex); return stopping; }
+
+    void Notify()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (notify)
+            notify();
+    }
+
+    void MarkLoaded(bool failed)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            loaded = !failed;
+            loadFailed = failed;
+        }
+        Notify();
+    }
+
+    void Refresh(const std::wstring& path)
+    {
+        VolumeStatus status;
+        if (source->ReadVolume(path, status))
+            Apply(status);
+    }
+
+    void Run()
+    {
+        if (!source->Open())
+        {
+            MarkLoaded(true);
+            return;
+        }
+
+        // Full enumeration, once. Stop() is honored between volumes.
+        bool enumerated = source->EnumerateVolumes([this](const VolumeStatus& status)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+                return false;
+            volumes[status.deviceId] = status;
+            return true;
+        });
+        if (IsStopping())
+        {
+            source->Close();
+            return;
+        }
+        if (!enumerated)
+        {
+            LogMessage(L"Status snapshot: enumerating volumes failed.");
+            MarkLoaded(true);
+            source->Close();
+            return;
+        }
+        MarkLoaded(false);
+        TraceInstant("Status snapshot loaded");
+        LogMessage(L"Status snapshot loaded.");
+
+        // From here on, changed volumes are re-read as they are reported, and every
+        // volume on the slow timer.
+        if (!source->Subscribe([this](const std::wstring& path) { RequestRefresh(path); }))
+            LogMessage(L"Status snapshot: event subscription failed; status will refresh on the timer and after changes made here.");
+
+        auto nextFullRefresh = std::chrono::steady_clock::now() + fullRefreshInterval;
+        for (;;)
+        {
+            std::vector<std::wstring> paths;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait_until(lock, nextFullRefresh, [this] { return stopping || !pending.empty(); });
+                if (stopping)
+                    break;
+                if (!pending.empty())
+                {
+                    paths.push_back(pending.front());
+                    pending.pop_front();
+                }
+                else
+                {
+                    for (const auto& entry : volumes)
+                        paths.push_back(entry.second.path);
+                    nextFullRefresh = std::chrono::steady_clock::now() + fullRefreshInterval;
+                }
+            }
+            for (const std::wstring& path : paths)
+            {
+                if (IsStopping())
+                    break;
+                Refresh(path);
+            }
+        }
+        source->Close();
+    }
+
+    const std::chrono::milliseconds fullRefreshInterval;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    std::unique_ptr<VolumeStatusSource> source;
+    std::function<void()> notify;
+    std::map<std::wstring, VolumeStatus> volumes;
+    std::deque<std::wstring> pending;
+    bool stopping = false;
+    bool loaded = false;
+    bool loadFailed = false;
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cwchar>
+#include <string>
+
+// Longest command line the shared record can hold.
+const size_t COALESCED_COMMAND_LINE_LENGTH = 1024;
+
+enum CoalescedLaunchState : uint32_t {
+    LaunchEmpty = 0,                // New record.
+    LaunchPending = 1,              // Seen under the lock only if the leader died.
+    LaunchSucceeded = 2,
+    LaunchFailed = 3,
+    LaunchExited = 4
+};
+
+// Record shared by all ServiceUIClone processes launching the same command line
+// into the same session. Plain data only, so the coalescing logic below does not
+// depend on the platform. ServiceUIClone keeps it in a named section keyed by a
+// hash of both (see LaunchCoalescer.h).
+struct CoalescedLaunch {
+    uint32_t state;                 // CoalescedLaunchState.
+    uint32_t sessionId;
+    uint32_t processId;
+    uint32_t error;                 // Launch error if state is Failed.
+    uint32_t exitCode;              // Valid once state is Exited.
+    uint64_t creationTime;          // Child creation time, guards against PID reuse.
+    uint64_t launchMs;              // When the outcome was published.
+    wchar_t commandLine[COALESCED_COMMAND_LINE_LENGTH + 1];
+};
+
+// What a follower reports: a copy of the record taken under the lock, since a
+// new leader may reset the record as soon as the lock is released.
+struct CoalescedOutcome {
+    uint32_t state = LaunchEmpty;
+    uint32_t processId = 0;
+    uint64_t creationTime = 0;
+    uint32_t error = 0;
+};
+
+// Single-flight decisions over a CoalescedLaunch. Every caller holds the key's
+// lock; a leader keeps holding it from Join until Publish, so duplicates arriving
+// meanwhile wait for the outcome instead of launching again.
+class LaunchCoalescing {
+public:
+    enum class Role { Leader, Follower, Independent };
+
+    // Follows a launch published within the window whose process is still
+    // running (isAlive(processId, creationTime)), or one that failed within the
+    // window. Otherwise leads: the record is reset to Pending and the caller
+    // keeps the lock until Publish.
+    template <typename IsAlive>
+    static Role Join(CoalescedLaunch& record, uint32_t sessionId, const std::wstring& commandLine,
+        uint64_t nowMs, uint64_t windowMs, IsAlive isAlive, CoalescedOutcome& outcome) {
+        if (commandLine.size() > COALESCED_COMMAND_LINE_LENGTH)
+            return Role::Independent;
+        uint32_t state = record.state;
+        if (state != LaunchEmpty && (record.sessionId != sessionId || commandLine != record.commandLine))
+            return Role::Independent;   // Hash collision.
+
+        bool recent = nowMs - record.launchMs <= windowMs;
+        if (recent && (state == LaunchFailed ||
+            (state == LaunchSucceeded && isAlive(record.processId, record.creationTime)))) {
+            outcome.state = state;
+            outcome.processId = record.processId;
+            outcome.creationTime = record.creationTime;
+            outcome.error = record.error;
+            return Role::Follower;
+        }
+
+        record.state = LaunchPending;
+        record.sessionId = sessionId;
+        record.processId = 0;
+        record.error = 0;
+        record.exitCode = 0;
+        record.creationTime = 0;
+        wmemcpy(record.commandLine, commandLine.c_str(), commandLine.size() + 1);
+        return Role::Leader;
+    }
+
+    // Leader: records the launch outcome. error is 0 on success.
+    static void Publish(CoalescedLaunch& record, uint32_t processId, uint64_t creationTime,
+        uint32_t error, uint64_t nowMs) {
+        record.processId = processId;
+        record.creationTime = creationTime;
+        record.error = error;
+        record.launchMs = nowMs;
+        record.state = error == 0 ? LaunchSucceeded : LaunchFailed;
+    }
+
+    // Leader: records the child's exit code, if the record still describes its launch.
+    static void PublishExit(CoalescedLaunch& record, uint32_t processId, uint64_t creationTime, uint32_t exitCode) {
+        if (record.state != LaunchSucceeded || record.processId != processId || record.creationTime != creationTime)
+            return;
+        record.exitCode = exitCode;
+        record.state = LaunchExited;
+    }
+
+    // Follower: the exit code of the launch it followed, once its leader has
+    // published it and while the record still describes that launch.
+    static bool ExitCode(const CoalescedLaunch& record, const CoalescedOutcome& outcome, uint32_t& exitCode) {
+        if (record.state != LaunchExited || record.processId != outcome.processId ||
+            record.creationTime != outcome.creationTime)
+            return false;
+        exitCode = record.exitCode;
+        return true;
+    }
+
+    // FNV-1a over the session ID and the normalized command line. Each key has
+    // its own lock, so unrelated launches never contend.
+    static uint64_t HashKey(uint32_t sessionId, const std::wstring& commandLine) {
+        uint64_t hash = 14695981039346656037ULL;
+        auto mix = [&hash](const void* data, size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+        mix(&sessionId, sizeof(sessionId));
+        mix(commandLine.data(), commandLine.size() * sizeof(wchar_t));
+        return hash;
+    }
+};
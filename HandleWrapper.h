@@ -0,0 +1,19 @@
+#pragma once
+
+#include <windows.h>
+
+// RAII helper for HANDLE.
+class HandleWrapper {
+public:
+    HandleWrapper(HANDLE h = nullptr) : handle(h) {}
+    ~HandleWrapper() { if (handle && handle != INVALID_HANDLE_VALUE) CloseHandle(handle); }
+    HANDLE get() const { return handle; }
+    void reset(HANDLE h = nullptr) {
+        if (handle && handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+        handle = h;
+    }
+private:
+    HANDLE handle;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <windows.h>
+#include <tchar.h>
+#include <string>
+#include <cwchar>
+#include "HandleWrapper.h"
+#include "Trace.h"
+#include "Logging.h"
+#include "CoalescedLaunch.h"
+
+// Single-flight coalescing of duplicate launches across processes.
+//
+// Every process for a (session, command line) key opens the same named mutex and
+// record and decides under the mutex (see LaunchCoalescing in CoalescedLaunch.h).
+// If the record holds a launch published within the dedup window whose process is
+// still running, or a launch that failed within the window, the process is a
+// follower and reports that outcome.
+// Otherwise it becomes the leader and keeps the mutex until Publish(), so
+// duplicates arriving meanwhile wait for the outcome. A leader that dies before
+// publishing abandons the mutex and the next process takes over.
+//
+// Publish() duplicates the record's handle into the launched process, so the
+// record outlives the leader without the leader having to wait for the window to
+// pass. Each key has its own kernel objects, so unrelated launches never contend.
+class LaunchCoalescer {
+public:
+    using Role = LaunchCoalescing::Role;
+
+    // Kernel object names start with objectNamespace ("Local\\" in tests).
+    explicit LaunchCoalescer(const wchar_t* objectNamespace = L"Global\\") : objectNamespace(objectNamespace) {}
+    LaunchCoalescer(const LaunchCoalescer&) = delete;
+    LaunchCoalescer& operator=(const LaunchCoalescer&) = delete;
+
+    ~LaunchCoalescer() {
+        if (role == Role::Leader && !published)
+            Publish(nullptr, 0, 0, ERROR_CANCELLED);
+        if (record)
+            UnmapViewOfFile(record);
+    }
+
+    Role Join(DWORD sessionId, const std::wstring& commandLine, DWORD dedupWindowMs) {
+        TraceSpan span("LaunchCoalescer::Join");
+        if (commandLine.size() > COALESCED_COMMAND_LINE_LENGTH)
+            return role = Role::Independent;
+        ULONGLONG key = LaunchCoalescing::HashKey(sessionId, commandLine);
+        WCHAR mutexName[96], sectionName[96];
+        swprintf_s(mutexName, L"%sServiceUIClone.Launch.v2.%016llX", objectNamespace, key);
+        swprintf_s(sectionName, L"%sServiceUIClone.Launch.v2.%016llX.Record", objectNamespace, key);
+
+        hMutex.reset(CreateMutexW(nullptr, FALSE, mutexName));
+        if (!hMutex.get()) {
+            PrintError(_T("CreateMutex for launch coalescing failed."));
+            return role = Role::Independent;
+        }
+        hSection.reset(CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            0, sizeof(CoalescedLaunch), sectionName));
+        if (!hSection.get() || !MapRecord()) {
+            PrintError(_T("Failed to open the launch coalescing record."));
+            return role = Role::Independent;
+        }
+
+        // Duplicates of a launch in progress wait here until its leader publishes.
+        if (!Lock())
+            return role = Role::Independent;
+        role = LaunchCoalescing::Join(*record, sessionId, commandLine, GetTickCount64(), dedupWindowMs,
+            IsProcessAlive, outcome);
+        // A leader keeps the mutex until Publish().
+        if (role != Role::Leader)
+            ReleaseMutex(hMutex.get());
+        return role;
+    }
+
+    // Leader only: publishes the launch outcome and wakes the followers. After a
+    // successful launch the record's handle is also given to the new process.
+    void Publish(HANDLE hProcess, DWORD processId, ULONGLONG creationTime, DWORD error) {
+        if (role != Role::Leader || !record || published)
+            return;
+        if (error == ERROR_SUCCESS && hProcess) {
+            HANDLE hChildSection = nullptr;
+            if (!DuplicateHandle(GetCurrentProcess(), hSection.get(), hProcess, &hChildSection,
+                0, FALSE, DUPLICATE_SAME_ACCESS)) {
+                PrintError(_T("Could not hand the launch coalescing record to the launched process."));
+            }
+        }
+        LaunchCoalescing::Publish(*record, processId, creationTime, error, GetTickCount64());
+        published = true;
+        outcome.processId = processId;
+        outcome.creationTime = creationTime;
+        ReleaseMutex(hMutex.get());
+    }
+
+    // Leader only: publishes the child's exit code for followers using /wait.
+    void PublishExit(DWORD exitCode) {
+        if (role != Role::Leader || !published || !Lock())
+            return;
+        LaunchCoalescing::PublishExit(*record, outcome.processId, outcome.creationTime, exitCode);
+        ReleaseMutex(hMutex.get());
+    }
+
+    // Follower only: the outcome of the launch coalesced with, as seen in Join().
+    bool LaunchSucceededForFollower() const { return outcome.state != LaunchFailed; }
+    DWORD ProcessId() const { return outcome.processId; }
+    DWORD Error() const { return outcome.error; }
+
+    // Follower only: waits for the leader's child and returns its exit code.
+    bool WaitForExit(DWORD& exitCode) {
+        if (role != Role::Follower || outcome.state != LaunchSucceeded)
+            return false;
+        HandleWrapper hProcess(OpenLaunchedProcess(outcome.processId, outcome.creationTime));
+        if (hProcess.get()) {
+            if (WaitForSingleObject(hProcess.get(), INFINITE) == WAIT_OBJECT_0)
+                return GetExitCodeProcess(hProcess.get(), &exitCode) != FALSE;
+            return false;
+        }
+        // The child has already gone; only a waiting leader can tell us its code.
+        if (!Lock())
+            return false;
+        uint32_t code = 0;
+        bool known = LaunchCoalescing::ExitCode(*record, outcome, code);
+        ReleaseMutex(hMutex.get());
+        exitCode = code;
+        return known;
+    }
+
+    static ULONGLONG FileTimeToULongLong(const FILETIME& ft) {
+        return (static_cast<ULONGLONG>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    }
+
+private:
+    bool MapRecord() {
+        record = static_cast<CoalescedLaunch*>(MapViewOfFile(hSection.get(),
+            FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(CoalescedLaunch)));
+        return record != nullptr;
+    }
+
+    // A leader that died before publishing abandons the mutex; the record is then
+    // still Pending, so the next process leads in its place.
+    bool Lock() {
+        DWORD waitResult = WaitForSingleObject(hMutex.get(), INFINITE);
+        if (waitResult == WAIT_ABANDONED)
+            LogMessage(L"A duplicate launch exited holding the coalescing mutex; taking over.");
+        else if (waitResult != WAIT_OBJECT_0)
+            PrintError(_T("Waiting for the launch coalescing mutex failed."));
+        return waitResult == WAIT_OBJECT_0 || waitResult == WAIT_ABANDONED;
+    }
+
+    // Opens the recorded process, or returns nullptr if it is gone. The creation
+    // time check guards against the PID having been reused.
+    static HANDLE OpenLaunchedProcess(DWORD processId, ULONGLONG creationTime) {
+        HANDLE hProcess = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION,
+            FALSE, processId);
+        if (!hProcess)
+            return nullptr;
+        FILETIME creation, exitTime, kernel, user;
+        if (!GetProcessTimes(hProcess, &creation, &exitTime, &kernel, &user) ||
+            FileTimeToULongLong(creation) != creationTime) {
+            CloseHandle(hProcess);
+            return nullptr;
+        }
+        return hProcess;
+    }
+
+    static bool IsProcessAlive(uint32_t processId, uint64_t creationTime) {
+        HandleWrapper hProcess(OpenLaunchedProcess(processId, creationTime));
+        return hProcess.get() && WaitForSingleObject(hProcess.get(), 0) == WAIT_TIMEOUT;
+    }
+
+    const wchar_t* objectNamespace;
+    Role role = Role::Independent;
+    bool published = false;
+    CoalescedOutcome outcome;       // A follower's copy of the record; a leader's own launch.
+    HandleWrapper hMutex;
+    HandleWrapper hSection;
+    CoalescedLaunch* record = nullptr;
+};
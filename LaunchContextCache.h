@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdint>
+#include <cwchar>
+#include <string>
+
+// Capacity of the shared launch context cache. Fixed because it lives in a named section.
+const uint32_t LAUNCH_CONTEXT_CACHE_ENTRIES = 8;
+const uint32_t LAUNCH_CONTEXT_ENVIRONMENT_LENGTH = 32768;     // Characters, including the final NULs.
+const uint32_t LAUNCH_CONTEXT_PATH_LENGTH = 520;
+const uint32_t LAUNCH_CONTEXT_SID_LENGTH = 192;
+
+// What a launch into a session needs from the session's user: the environment
+// block (NUL-separated "name=value" strings ending with an empty string) and the
+// profile directory, used as the child's working directory.
+struct LaunchContext {
+    std::wstring environment;           // Empty if unavailable.
+    std::wstring profileDirectory;      // Empty if unavailable.
+    std::wstring desktop = L"winsta0\\default";
+    std::wstring userSid;               // Whose environment stamp to check, see LaunchContextSource.
+    uint64_t environmentStamp = 0;      // Read before the environment was built.
+};
+
+// Where launch contexts come from. ServiceUIClone reads them from the session
+// user's token and the registry; tests use a fake.
+class LaunchContextSource {
+public:
+    virtual ~LaunchContextSource() = default;
+
+    // Logon time of the session's user; a new logon gives a new time. Returns
+    // false if nobody is logged on.
+    virtual bool LogonTime(uint32_t sessionId, uint64_t& logonTime) = 0;
+
+    // Changes whenever the system or the user's stored environment changes.
+    virtual uint64_t EnvironmentStamp(const std::wstring& userSid) = 0;
+
+    // Builds the context from scratch: the expensive profile round trip.
+    virtual bool Build(uint32_t sessionId, LaunchContext& context) = 0;
+};
+
+// Launch contexts shared by every ServiceUIClone process. Plain data only, so
+// the cache logic below does not depend on the platform.
+struct LaunchContextCacheState {
+    uint64_t useCounter;                // Orders entries for eviction.
+
+    struct Entry {
+        uint32_t used;
+        uint32_t sessionId;
+        uint64_t logonTime;
+        uint64_t environmentStamp;
+        uint64_t lastUsed;
+        wchar_t userSid[LAUNCH_CONTEXT_SID_LENGTH];
+        wchar_t profileDirectory[LAUNCH_CONTEXT_PATH_LENGTH];
+        uint32_t environmentLength;
+        wchar_t environment[LAUNCH_CONTEXT_ENVIRONMENT_LENGTH];
+    } entries[LAUNCH_CONTEXT_CACHE_ENTRIES];
+
+    // Metrics.
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;             // Entries dropped because the environment changed.
+};
+
+// Per-session launch context cache over LaunchContextCacheState. Entries are
+// keyed by session ID and logon time, so a new logon into the session never
+// sees the previous user's context, and are dropped when the environment stamp
+// moves. Callers serialize access to the state.
+class LaunchContextCache {
+public:
+    // Copies the cached context for the session into context. Returns false on
+    // a miss, after which the caller builds the context and calls Store.
+    static bool Lookup(LaunchContextCacheState& state, LaunchContextSource& source,
+        uint32_t sessionId, uint64_t logonTime, LaunchContext& context) {
+        int slot = Find(state, sessionId, logonTime);
+        if (slot < 0) {
+            ++state.misses;
+            return false;
+        }
+        LaunchContextCacheState::Entry& entry = state.entries[slot];
+        if (source.EnvironmentStamp(entry.userSid) != entry.environmentStamp) {
+            entry.used = 0;
+            ++state.invalidations;
+            ++state.misses;
+            return false;
+        }
+        context.environment.assign(entry.environment, entry.environmentLength);
+        context.profileDirectory = entry.profileDirectory;
+        context.userSid = entry.userSid;
+        context.environmentStamp = entry.environmentStamp;
+        entry.lastUsed = ++state.useCounter;
+        ++state.hits;
+        return true;
+    }
+
+    // Caches a freshly built context, replacing any entry for an earlier logon
+    // into the session, or else a free or the least recently used entry.
+    // Returns false if the context is too large to cache.
+    static bool Store(LaunchContextCacheState& state, uint32_t sessionId, uint64_t logonTime,
+        const LaunchContext& context) {
+        if (context.environment.size() > LAUNCH_CONTEXT_ENVIRONMENT_LENGTH ||
+            context.profileDirectory.size() >= LAUNCH_CONTEXT_PATH_LENGTH ||
+            context.userSid.size() >= LAUNCH_CONTEXT_SID_LENGTH)
+            return false;
+
+        uint32_t slot = 0;
+        for (uint32_t i = 0; i < LAUNCH_CONTEXT_CACHE_ENTRIES; ++i) {
+            const LaunchContextCacheState::Entry& e = state.entries[i];
+            if (e.used && e.sessionId == sessionId) {
+                slot = i;
+                break;
+            }
+            const LaunchContextCacheState::Entry& best = state.entries[slot];
+            if (best.used && (!e.used || e.lastUsed < best.lastUsed))
+                slot = i;
+        }
+
+        // The entry is marked used only once it is complete, so a process that dies
+        // in the middle of Store leaves a free entry rather than a half-written one.
+        LaunchContextCacheState::Entry& entry = state.entries[slot];
+        entry.used = 0;
+        entry.sessionId = sessionId;
+        entry.logonTime = logonTime;
+        entry.environmentStamp = context.environmentStamp;
+        entry.lastUsed = ++state.useCounter;
+        Copy(entry.userSid, context.userSid);
+        Copy(entry.profileDirectory, context.profileDirectory);
+        entry.environmentLength = static_cast<uint32_t>(context.environment.size());
+        wmemcpy(entry.environment, context.environment.data(), context.environment.size());
+        entry.used = 1;
+        return true;
+    }
+
+    static double HitRate(const LaunchContextCacheState& state) {
+        uint64_t total = state.hits + state.misses;
+        return total ? static_cast<double>(state.hits) / total : 0.0;
+    }
+
+private:
+    static int Find(const LaunchContextCacheState& state, uint32_t sessionId, uint64_t logonTime) {
+        for (uint32_t i = 0; i < LAUNCH_CONTEXT_CACHE_ENTRIES; ++i) {
+            const LaunchContextCacheState::Entry& e = state.entries[i];
+            if (e.used && e.sessionId == sessionId && e.logonTime == logonTime)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    template <size_t N>
+    static void Copy(wchar_t (&target)[N], const std::wstring& source) {
+        wmemcpy(target, source.c_str(), source.size() + 1);
+    }
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#ifdef _WIN32
+#include <tchar.h>
+#endif
+
+// Logging functions defined by each program (ServiceUIClone.cpp, BitLockerPINUI.cpp
+// or a test) and used by the headers the programs share.
+void LogMessage(const std::wstring& msg);
+#ifdef _WIN32
+void PrintError(const TCHAR* msg);
+#endif
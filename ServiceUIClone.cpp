@@ -1,34 +1,127 @@
 #include <windows.h>
 #include <wtsapi32.h>
+#include <userenv.h>
+#include <sddl.h>
+#include <tlhelp32.h>
 #include <tchar.h>
-#include <iostream>
 #include <string>
+#include <stdexcept>
+#include <memory>
+#include <atomic>
+#include <cwchar>
+#include <cwctype>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+// Build with SERVICEUICLONE_MINIMAL_STARTUP defined for the minimal-startup launcher:
+// same behavior, but console and log output go straight to handles, so no iostream
+// or locale initialization runs at startup.
+#ifndef SERVICEUICLONE_MINIMAL_STARTUP
+#include <iostream>
 #include <fstream>
-#include <sstream>
 #include <chrono>
 #include <iomanip>
-#include <stdexcept>
+#endif
+
+#include "HandleWrapper.h"
+#include "Trace.h"
+#include "LaunchCoalescer.h"
+#include "AdmissionScheduler.h"
+#include "LaunchContextCache.h"
 
 #pragma comment(lib, "wtsapi32.lib")
+#pragma comment(lib, "userenv.lib")
 
-// RAII helper for HANDLE.
-class HandleWrapper {
-public:
-    HandleWrapper(HANDLE h = nullptr) : handle(h) {}
-    ~HandleWrapper() { if (handle && handle != INVALID_HANDLE_VALUE) CloseHandle(handle); }
-    HANDLE get() const { return handle; }
-    void reset(HANDLE h = nullptr) {
-        if (handle && handle != INVALID_HANDLE_VALUE) {
-            CloseHandle(handle);
-        }
-        handle = h;
+// Maximum accepted length of the combined command line.
+const size_t MAX_CMDLINE_LENGTH = 1024;
+
+// Returns a copy of a Unicode environment block (ours if null) with the trace
+// settings for a child process added, sorted by name as CreateProcess expects.
+std::wstring TraceEnvironmentForChild(LPVOID environment, uint64_t flow) {
+    LPWCH ownBlock = nullptr;
+    const wchar_t* block = static_cast<const wchar_t*>(environment);
+    if (!block)
+        block = ownBlock = GetEnvironmentStringsW();
+
+    std::vector<std::wstring> entries;
+    for (const wchar_t* p = block; p && *p; p += wcslen(p) + 1) {
+        if (_wcsnicmp(p, L"SERVICEUICLONE_TRACE=", 21) != 0 &&
+            _wcsnicmp(p, L"SERVICEUICLONE_TRACE_PARENT=", 28) != 0)
+            entries.push_back(p);
     }
-private:
-    HANDLE handle;
-};
+    if (ownBlock)
+        FreeEnvironmentStringsW(ownBlock);
+
+    WCHAR parent[32];
+    swprintf_s(parent, L"%llX", static_cast<unsigned long long>(flow));
+    entries.push_back(L"SERVICEUICLONE_TRACE=" + g_trace.path);
+    entries.push_back(std::wstring(L"SERVICEUICLONE_TRACE_PARENT=") + parent);
+    std::sort(entries.begin(), entries.end(), [](const std::wstring& a, const std::wstring& b) {
+        return _wcsicmp(a.c_str(), b.c_str()) < 0;
+    });
 
+    std::wstring result;
+    for (const std::wstring& entry : entries) {
+        result += entry;
+        result += L'\0';
+    }
+    result += L'\0';
+    return result;
+}
+
+#ifdef SERVICEUICLONE_MINIMAL_STARTUP
+// Helper: Convert a wide string to UTF-8.
+std::string ToUtf8(const std::wstring& text) {
+    int size = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()),
+        nullptr, 0, nullptr, nullptr);
+    std::string utf8(size > 0 ? size : 0, '\0');
+    if (size > 0)
+        WideCharToMultiByte(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()),
+            &utf8[0], size, nullptr, nullptr);
+    return utf8;
+}
+
+// Logging function: writes messages to a log file with a timestamp.
+void LogMessage(const std::wstring& msg) {
+    TraceInstant("LogMessage");
+    HANDLE hFile = CreateFileW(L"ServiceUIClone.log", FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+    SYSTEMTIME t;
+    GetLocalTime(&t);
+    // Format: [YYYY-MM-DD HH:MM:SS]
+    WCHAR stamp[32];
+    swprintf_s(stamp, L"[%04u-%02u-%02u %02u:%02u:%02u] ",
+        t.wYear, t.wMonth, t.wDay, t.wHour, t.wMinute, t.wSecond);
+    std::string line = ToUtf8(stamp + msg + L"\r\n");
+    DWORD written = 0;
+    WriteFile(hFile, line.data(), static_cast<DWORD>(line.size()), &written, nullptr);
+    CloseHandle(hFile);
+}
+
+// Helper: Write a line to standard output or standard error.
+void WriteStdLine(DWORD stdHandle, const std::wstring& text) {
+    HANDLE h = GetStdHandle(stdHandle);
+    if (!h || h == INVALID_HANDLE_VALUE)
+        return;
+    std::wstring line = text + L"\r\n";
+    DWORD written = 0, mode = 0;
+    if (GetConsoleMode(h, &mode)) {
+        WriteConsoleW(h, line.c_str(), static_cast<DWORD>(line.size()), &written, nullptr);
+    }
+    else {
+        std::string utf8 = ToUtf8(line);
+        WriteFile(h, utf8.data(), static_cast<DWORD>(utf8.size()), &written, nullptr);
+    }
+}
+#else
 // Logging function: writes messages to a log file with a timestamp.
 void LogMessage(const std::wstring& msg) {
+    TraceInstant("LogMessage");
     try {
         std::wofstream logFile(L"ServiceUIClone.log", std::ios::app);
         if (logFile) {
@@ -46,6 +139,15 @@ void LogMessage(const std::wstring& msg) {
     }
 }
 
+// Helper: Write a line to standard output or standard error.
+void WriteStdLine(DWORD stdHandle, const std::wstring& text) {
+    (stdHandle == STD_ERROR_HANDLE ? std::wcerr : std::wcout) << text << std::endl;
+}
+#endif
+
+void ConsoleOut(const std::wstring& text) { WriteStdLine(STD_OUTPUT_HANDLE, text); }
+void ConsoleErr(const std::wstring& text) { WriteStdLine(STD_ERROR_HANDLE, text); }
+
 // Helper: Print error messages with details.
 void PrintError(const TCHAR* msg) {
     DWORD errCode = GetLastError();
@@ -59,16 +161,14 @@ void PrintError(const TCHAR* msg) {
         0,
         nullptr
     );
-    std::wcerr << msg << _T(" Error Code: ") << errCode;
     std::wstring logStr = msg;
     logStr += L" Error Code: " + std::to_wstring(errCode);
     if (errorText) {
-        std::wcerr << _T(" - ") << errorText;
         logStr += L" - ";
         logStr += errorText;
         LocalFree(errorText);
     }
-    std::wcerr << std::endl;
+    ConsoleErr(logStr);
     LogMessage(logStr);
 }
 
@@ -105,22 +205,645 @@ std::wstring Trim(const std::wstring& str) {
     return str.substr(start, end - start + 1);
 }
 
+// Length of an environment block, up to and including the empty string that ends it.
+size_t EnvironmentBlockLength(const wchar_t* block) {
+    const wchar_t* p = block;
+    while (*p)
+        p += wcslen(p) + 1;
+    return p - block + 1;
+}
+
+// Reads launch contexts from the session user's token, and the logon time and
+// environment stamp from WTS and the registry, which costs far less.
+class UserLaunchContextSource : public LaunchContextSource {
+public:
+    bool LogonTime(uint32_t sessionId, uint64_t& logonTime) override {
+        LPWSTR buffer = nullptr;
+        DWORD bytes = 0;
+        if (!WTSQuerySessionInformationW(WTS_CURRENT_SERVER_HANDLE, sessionId, WTSSessionInfo, &buffer, &bytes))
+            return false;
+        logonTime = reinterpret_cast<WTSINFOW*>(buffer)->LogonTime.QuadPart;
+        WTSFreeMemory(buffer);
+        return logonTime != 0;
+    }
+
+    // Mixes the last-write times of the system and the user's environment keys.
+    uint64_t EnvironmentStamp(const std::wstring& userSid) override {
+        uint64_t stamp = 14695981039346656037ULL;
+        stamp = Mix(stamp, LastWriteTime(HKEY_LOCAL_MACHINE,
+            L"SYSTEM\\CurrentControlSet\\Control\\Session Manager\\Environment"));
+        stamp = Mix(stamp, LastWriteTime(HKEY_USERS, userSid + L"\\Environment"));
+        return stamp;
+    }
+
+    bool Build(uint32_t sessionId, LaunchContext& context) override {
+        TraceSpan span("UserLaunchContextSource::Build");
+        HANDLE hUserTokenRaw = nullptr;
+        if (!WTSQueryUserToken(sessionId, &hUserTokenRaw)) {
+            PrintError(_T("WTSQueryUserToken failed."));
+            return false;
+        }
+        HandleWrapper hUserToken(hUserTokenRaw);
+
+        BYTE userBuffer[SECURITY_MAX_SID_SIZE + sizeof(TOKEN_USER)];
+        DWORD userSize = 0;
+        LPWSTR sidString = nullptr;
+        if (!GetTokenInformation(hUserToken.get(), TokenUser, userBuffer, sizeof(userBuffer), &userSize) ||
+            !ConvertSidToStringSidW(reinterpret_cast<TOKEN_USER*>(userBuffer)->User.Sid, &sidString)) {
+            PrintError(_T("Failed to read the session user's SID."));
+            return false;
+        }
+        context.userSid = sidString;
+        LocalFree(sidString);
+
+        // Stamped before the block is built, so a change made meanwhile shows up next time.
+        context.environmentStamp = EnvironmentStamp(context.userSid);
+        LPVOID environment = nullptr;
+        if (!CreateEnvironmentBlock(&environment, hUserToken.get(), FALSE)) {
+            PrintError(_T("CreateEnvironmentBlock failed."));
+            return false;
+        }
+        const wchar_t* block = static_cast<const wchar_t*>(environment);
+        context.environment.assign(block, EnvironmentBlockLength(block));
+        DestroyEnvironmentBlock(environment);
+
+        // A missing profile directory is not fatal; the child then inherits our directory.
+        DWORD size = 0;
+        GetUserProfileDirectory(hUserToken.get(), nullptr, &size);
+        if (size > 0) {
+            std::wstring dir(size, L'\0');
+            if (GetUserProfileDirectory(hUserToken.get(), &dir[0], &size)) {
+                dir.resize(wcslen(dir.c_str()));
+                context.profileDirectory = dir;
+            }
+        }
+        if (context.profileDirectory.empty()) {
+            PrintError(_T("GetUserProfileDirectory failed."));
+        }
+        return true;
+    }
+
+private:
+    static uint64_t LastWriteTime(HKEY root, const std::wstring& path) {
+        HKEY hKey = nullptr;
+        if (RegOpenKeyExW(root, path.c_str(), 0, KEY_QUERY_VALUE, &hKey) != ERROR_SUCCESS)
+            return 0;
+        FILETIME lastWrite = {};
+        LONG status = RegQueryInfoKeyW(hKey, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+            nullptr, nullptr, nullptr, nullptr, &lastWrite);
+        RegCloseKey(hKey);
+        return status == ERROR_SUCCESS ? LaunchCoalescer::FileTimeToULongLong(lastWrite) : 0;
+    }
+
+    static uint64_t Mix(uint64_t hash, uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (value >> (i * 8)) & 0xFF;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+};
+
+// Launch context cache shared by all ServiceUIClone processes: the state lives
+// in a named section guarded by a named mutex. The context is built outside the
+// lock, so a miss does not hold up launches into other sessions.
+//
+// Every launched process gets a handle to the section (see HandTo), so the cache
+// lasts as long as anything launched through it is still running, not just
+// while a launcher happens to be running.
+class SharedLaunchContextCache {
+public:
+    SharedLaunchContextCache() = default;
+    SharedLaunchContextCache(const SharedLaunchContextCache&) = delete;
+    SharedLaunchContextCache& operator=(const SharedLaunchContextCache&) = delete;
+    ~SharedLaunchContextCache() {
+        if (state)
+            UnmapViewOfFile(state);
+    }
+
+    // Returns the session's launch context, from the cache if it is still valid.
+    // Returns nullptr if the context could not be built.
+    std::unique_ptr<LaunchContext> Get(DWORD sessionId, LaunchContextSource& source) {
+        TraceSpan span("SharedLaunchContextCache::Get");
+        std::unique_ptr<LaunchContext> context(new LaunchContext());
+        uint64_t logonTime = 0;
+        if (!source.LogonTime(sessionId, logonTime) || !Open()) {
+            LogMessage(L"Launch context cache unavailable; building the context directly.");
+            if (!source.Build(sessionId, *context))
+                return nullptr;
+            return context;
+        }
+
+        if (Lock()) {
+            bool hit = LaunchContextCache::Lookup(*state, source, sessionId, logonTime, *context);
+            Unlock();
+            if (hit) {
+                LogMetrics(L"hit");
+                return context;
+            }
+        }
+        if (!source.Build(sessionId, *context))
+            return nullptr;
+        if (Lock()) {
+            if (!LaunchContextCache::Store(*state, sessionId, logonTime, *context))
+                LogMessage(L"Launch context too large to cache.");
+            Unlock();
+        }
+        LogMetrics(L"miss");
+        return context;
+    }
+
+    // Gives the launched process a handle to the cache, which keeps it alive.
+    void HandTo(HANDLE hProcess) {
+        if (!state || !hProcess)
+            return;
+        HANDLE hChildSection = nullptr;
+        if (!DuplicateHandle(GetCurrentProcess(), hSection.get(), hProcess, &hChildSection,
+            0, FALSE, DUPLICATE_SAME_ACCESS)) {
+            PrintError(_T("Could not hand the launch context cache to the launched process."));
+        }
+    }
+
+private:
+    bool Open() {
+        hLock.reset(CreateMutex(nullptr, FALSE, L"Global\\ServiceUIClone.LaunchContext.v1.Lock"));
+        hSection.reset(CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            0, sizeof(LaunchContextCacheState), L"Global\\ServiceUIClone.LaunchContext.v1"));
+        if (!hLock.get() || !hSection.get()) {
+            PrintError(_T("Failed to open the launch context cache."));
+            return false;
+        }
+        state = static_cast<LaunchContextCacheState*>(MapViewOfFile(hSection.get(),
+            FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(LaunchContextCacheState)));
+        if (!state) {
+            PrintError(_T("Failed to map the launch context cache."));
+            return false;
+        }
+        return true;
+    }
+
+    // A launcher that died holding the lock leaves no half-written entry behind
+    // (see LaunchContextCache::Store), so an abandoned lock is simply taken over.
+    bool Lock() {
+        DWORD waitResult = WaitForSingleObject(hLock.get(), INFINITE);
+        return waitResult == WAIT_OBJECT_0 || waitResult == WAIT_ABANDONED;
+    }
+
+    void Unlock() { ReleaseMutex(hLock.get()); }
+
+    void LogMetrics(const wchar_t* outcome) {
+        WCHAR hitRate[16];
+        swprintf_s(hitRate, L"%.2f", LaunchContextCache::HitRate(*state));
+        LogMessage(std::wstring(L"Launch context cache ") + outcome
+            + L". Hits: " + std::to_wstring(state->hits)
+            + L", misses: " + std::to_wstring(state->misses)
+            + L", invalidated: " + std::to_wstring(state->invalidations)
+            + L", hit rate: " + hitRate);
+    }
+
+    HandleWrapper hLock;
+    HandleWrapper hSection;
+    LaunchContextCacheState* state = nullptr;
+};
+
+// How long an admitted launch keeps its slot while the new process starts up.
+const DWORD ADMISSION_STARTUP_TIMEOUT_MS = 5000;
+
+// How long a launcher waits before retrying when the admission queue is full.
+const DWORD ADMISSION_QUEUE_FULL_RETRY_MS = 250;
+
+// Names the caller for fair queueing: the /flow: tag if one was given, otherwise
+// the image name of the process that started us.
+std::wstring CallerFlowName(const std::wstring& tag) {
+    if (!tag.empty())
+        return tag;
+    HandleWrapper hSnapshot(CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0));
+    if (hSnapshot.get() == INVALID_HANDLE_VALUE)
+        return L"unknown";
+    PROCESSENTRY32W entry = {};
+    entry.dwSize = sizeof(entry);
+    DWORD parentId = 0;
+    for (BOOL more = Process32FirstW(hSnapshot.get(), &entry); more; more = Process32NextW(hSnapshot.get(), &entry)) {
+        if (entry.th32ProcessID == GetCurrentProcessId()) {
+            parentId = entry.th32ParentProcessID;
+            break;
+        }
+    }
+    for (BOOL more = Process32FirstW(hSnapshot.get(), &entry); more && parentId; more = Process32NextW(hSnapshot.get(), &entry)) {
+        if (entry.th32ProcessID == parentId)
+            return entry.szExeFile;
+    }
+    return L"unknown";
+}
+
+// FNV-1a over the lower-cased flow name.
+uint32_t FlowKey(const std::wstring& name) {
+    uint32_t hash = 2166136261u;
+    for (wchar_t c : name) {
+        hash ^= static_cast<uint32_t>(towlower(c));
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Cross-process admission control in front of the launch stage. The state lives
+// in a named section guarded by a named mutex. Each waiter sleeps on its own
+// named event. Whoever changes the head of the queue wakes only the new head,
+// which then waits for the next token by itself (see AdmissionScheduler::WaitMs).
+// The first process to create the section sets the limits.
+class LaunchAdmission {
+public:
+    LaunchAdmission() = default;
+    LaunchAdmission(const LaunchAdmission&) = delete;
+    LaunchAdmission& operator=(const LaunchAdmission&) = delete;
+    ~LaunchAdmission() {
+        Release();
+        if (state)
+            UnmapViewOfFile(state);
+    }
+
+    // Blocks until the launch is admitted. Returns false if admission control
+    // is unavailable, in which case the launch proceeds unthrottled.
+    bool Admit(uint32_t flowKey, DWORD maxInFlight, double ratePerSecond, double weight) {
+        TraceSpan span("LaunchAdmission::Admit");
+        self = CurrentOwner();
+        hLock.reset(CreateMutex(nullptr, FALSE, L"Global\\ServiceUIClone.Admission.v2.Lock"));
+        hWake.reset(CreateEvent(nullptr, FALSE, FALSE, WaiterEventName(self.processId).c_str()));
+        hSection.reset(CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            0, sizeof(AdmissionState), L"Global\\ServiceUIClone.Admission.v2"));
+        if (!hLock.get() || !hWake.get() || !hSection.get()) {
+            PrintError(_T("Failed to open the admission control objects."));
+            return false;
+        }
+        state = static_cast<AdmissionState*>(MapViewOfFile(hSection.get(),
+            FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(AdmissionState)));
+        if (!state) {
+            PrintError(_T("Failed to map the admission control state."));
+            return false;
+        }
+
+        // A full queue does not bypass the limits: keep retrying until there is room.
+        int slot = -1;
+        uint32_t depthAtEnqueue = 0;
+        bool reportedFull = false;
+        for (;;) {
+            if (!Lock())
+                return false;
+            ULONGLONG now = GetTickCount64();
+            if (!state->initialized)
+                AdmissionScheduler::Configure(*state, maxInFlight, ratePerSecond, now);
+            ReapIfDue(now);
+            slot = AdmissionScheduler::Enqueue(*state, self, flowKey, weight, now);
+            depthAtEnqueue = state->queueDepth;
+            Unlock();
+            if (slot >= 0)
+                break;
+            if (!reportedFull) {
+                LogMessage(L"Admission queue is full; waiting for room.");
+                reportedFull = true;
+            }
+            WaitForSingleObject(hWake.get(), ADMISSION_QUEUE_FULL_RETRY_MS);
+        }
+        LogMessage(L"Queued for admission. Queue depth: " + std::to_wstring(depthAtEnqueue));
+
+        ULONGLONG enqueuedMs = GetTickCount64();
+        ULONGLONG now = enqueuedMs;
+        for (;;) {
+            if (!Lock())
+                return false;
+            now = GetTickCount64();
+            ReapIfDue(now);
+            if (AdmissionScheduler::TryAdmit(*state, slot, now))
+                break;
+            int wake = -1;
+            DWORD delay = static_cast<DWORD>(AdmissionScheduler::WaitMs(*state, slot, now, wake));
+            DWORD next = WaiterProcessId(wake);
+            Unlock();
+            Wake(next);
+            WaitForSingleObject(hWake.get(), delay);
+        }
+        admitted = true;
+        std::wstring metrics = L"Launch admitted after " + std::to_wstring(now - enqueuedMs) + L" ms."
+            + L" Queue depth: " + std::to_wstring(state->queueDepth)
+            + L", in flight: " + std::to_wstring(state->inFlightCount)
+            + L", admitted: " + std::to_wstring(state->admitted)
+            + L", average wait: " + std::to_wstring(state->admitted ? state->totalWaitMs / state->admitted : 0) + L" ms"
+            + L", max wait: " + std::to_wstring(state->maxWaitMs) + L" ms"
+            + L", max queue depth: " + std::to_wstring(state->maxQueueDepth)
+            + L", queue full: " + std::to_wstring(state->queueFullWaits);
+        // The next waiter is now the head: it either goes as well or starts
+        // timing its wait for the next token.
+        DWORD next = WaiterProcessId(AdmissionScheduler::Head(*state));
+        Unlock();
+        LogMessage(metrics);
+        Wake(next);
+        return true;
+    }
+
+    // Frees the in-flight slot and wakes the next waiter.
+    void Release() {
+        if (!admitted || !state)
+            return;
+        admitted = false;
+        if (!Lock())
+            return;
+        AdmissionScheduler::Release(*state, self);
+        DWORD next = WaiterProcessId(AdmissionScheduler::Head(*state));
+        Unlock();
+        Wake(next);
+    }
+
+private:
+    // An abandoned lock means a launcher died inside it, so its entries are
+    // reaped straight away; otherwise dead launchers are looked for on a timer.
+    bool Lock() {
+        DWORD waitResult = WaitForSingleObject(hLock.get(), INFINITE);
+        lockAbandoned = waitResult == WAIT_ABANDONED;
+        return waitResult == WAIT_OBJECT_0 || waitResult == WAIT_ABANDONED;
+    }
+
+    void Unlock() { ReleaseMutex(hLock.get()); }
+
+    void ReapIfDue(ULONGLONG now) {
+        if (lockAbandoned || AdmissionScheduler::ReapDue(*state, now))
+            AdmissionScheduler::Reap(*state, IsProcessAlive, now);
+        lockAbandoned = false;
+    }
+
+    // Process ID of the waiter in slot, or 0 for no slot.
+    DWORD WaiterProcessId(int slot) const {
+        return slot >= 0 ? state->waiters[slot].owner.processId : 0;
+    }
+
+    static std::wstring WaiterEventName(DWORD processId) {
+        return L"Global\\ServiceUIClone.Admission.v2.Waiter." + std::to_wstring(processId);
+    }
+
+    static void Wake(DWORD processId) {
+        if (processId == 0 || processId == GetCurrentProcessId())
+            return;
+        HandleWrapper hEvent(OpenEvent(EVENT_MODIFY_STATE, FALSE, WaiterEventName(processId).c_str()));
+        if (hEvent.get())
+            SetEvent(hEvent.get());
+    }
+
+    static AdmissionOwner CurrentOwner() {
+        FILETIME creation = {}, exitTime, kernel, user;
+        GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user);
+        return { GetCurrentProcessId(), LaunchCoalescer::FileTimeToULongLong(creation) };
+    }
+
+    static bool IsProcessAlive(const AdmissionOwner& owner) {
+        HANDLE hProcess = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, owner.processId);
+        if (!hProcess)
+            return GetLastError() == ERROR_ACCESS_DENIED;
+        FILETIME creation, exitTime, kernel, user;
+        bool alive = GetProcessTimes(hProcess, &creation, &exitTime, &kernel, &user) &&
+            LaunchCoalescer::FileTimeToULongLong(creation) == owner.creationTime &&
+            WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+        CloseHandle(hProcess);
+        return alive;
+    }
+
+    HandleWrapper hLock;
+    HandleWrapper hWake;
+    HandleWrapper hSection;
+    AdmissionState* state = nullptr;
+    AdmissionOwner self = {};
+    bool admitted = false;
+    bool lockAbandoned = false;
+};
+
+// Resource accounting for a launched process tree through a job object. The child
+// is created suspended and assigned to the job before it runs, so every descendant
+// is counted. The totals are read after the last process in the job has exited,
+// off the launch path: with /wait by the launcher, which is waiting anyway;
+// otherwise by a detached copy of ServiceUIClone started with ACCOUNTING_WATCHER_SWITCH,
+// so the launcher exits as soon as the child is running.
+const wchar_t* const ACCOUNTING_WATCHER_SWITCH = L"/accounting-watcher";
+
+class LaunchAccounting {
+public:
+    // Creates the job. Returns false if accounting is unavailable.
+    bool Create() {
+        hJob.reset(CreateJobObject(nullptr, nullptr));
+        if (!hJob.get()) {
+            PrintError(_T("Failed to create the accounting job object."));
+            return false;
+        }
+        return true;
+    }
+
+    // Takes over a job handed off by a launcher (see HandOff).
+    void Adopt(HANDLE job, DWORD processId, ULONGLONG creationTime) {
+        hJob.reset(job);
+        rootProcessId = processId;
+        rootCreationTime = creationTime;
+        assigned = true;
+    }
+
+    // Assigns the suspended child to the job.
+    bool Assign(HANDLE hProcess, DWORD processId, ULONGLONG creationTime) {
+        rootProcessId = processId;
+        rootCreationTime = creationTime;
+        assigned = AssignProcessToJobObject(hJob.get(), hProcess) != FALSE;
+        return assigned;
+    }
+
+    // Starts the detached watcher and passes it the job, then lets go of it.
+    // The job handle is the only handle the watcher inherits.
+    bool HandOff() {
+        if (!assigned)
+            return true;
+        assigned = false;
+        TraceSpan span("LaunchAccounting::HandOff");
+
+        WCHAR selfPath[MAX_PATH];
+        DWORD length = GetModuleFileNameW(nullptr, selfPath, MAX_PATH);
+        if (length == 0 || length == MAX_PATH) {
+            PrintError(_T("Failed to locate ServiceUIClone.exe; resource accounting disabled."));
+            return false;
+        }
+        HANDLE job = hJob.get();
+        SIZE_T attributesSize = 0;
+        InitializeProcThreadAttributeList(nullptr, 1, 0, &attributesSize);
+        std::vector<BYTE> attributesBuffer(attributesSize);
+        LPPROC_THREAD_ATTRIBUTE_LIST attributes = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributesBuffer.data());
+        if (!InitializeProcThreadAttributeList(attributes, 1, 0, &attributesSize)) {
+            PrintError(_T("InitializeProcThreadAttributeList failed; resource accounting disabled."));
+            return false;
+        }
+        bool started = false;
+        if (!UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, &job, sizeof(job), nullptr, nullptr) ||
+            !SetHandleInformation(job, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT)) {
+            PrintError(_T("Failed to make the accounting job inheritable; resource accounting disabled."));
+        }
+        else {
+            std::wstring arguments = std::wstring(L"\"") + selfPath + L"\" " + ACCOUNTING_WATCHER_SWITCH + L" "
+                + std::to_wstring(reinterpret_cast<ULONG_PTR>(job)) + L" " + std::to_wstring(rootProcessId)
+                + L" " + std::to_wstring(rootCreationTime);
+            STARTUPINFOEXW si = {};
+            si.StartupInfo.cb = sizeof(si);
+            si.lpAttributeList = attributes;
+            si.StartupInfo.dwFlags = STARTF_USESTDHANDLES;      // No console; null standard handles.
+            PROCESS_INFORMATION pi = {};
+
+            // Break away from any job ServiceUIClone itself runs in, so the watcher is
+            // not killed with it; not every job allows that.
+            DWORD flags = EXTENDED_STARTUPINFO_PRESENT | DETACHED_PROCESS | CREATE_BREAKAWAY_FROM_JOB;
+            for (int attempt = 0; attempt < 2 && !started; ++attempt) {
+                std::wstring commandLine = arguments;
+                started = CreateProcessW(selfPath, &commandLine[0], nullptr, nullptr, TRUE, flags,
+                    nullptr, nullptr, &si.StartupInfo, &pi) != FALSE;
+                flags &= ~CREATE_BREAKAWAY_FROM_JOB;
+            }
+            if (started) {
+                LogMessage(L"Resource accounting handed to watcher process " + std::to_wstring(pi.dwProcessId) + L".");
+                CloseHandle(pi.hThread);
+                CloseHandle(pi.hProcess);
+            }
+            else {
+                PrintError(_T("Failed to start the accounting watcher; resource accounting disabled."));
+            }
+            SetHandleInformation(job, HANDLE_FLAG_INHERIT, 0);
+        }
+        DeleteProcThreadAttributeList(attributes);
+        return started;
+    }
+
+    // Blocks until every process in the job has exited, then records the totals
+    // in the log and on standard output.
+    void WaitAndReport() {
+        if (!assigned)
+            return;
+        assigned = false;
+        TraceSpan span("LaunchAccounting::WaitAndReport");
+        LogMessage(L"Waiting for the launched process tree to exit for resource accounting...");
+
+        HandleWrapper hPort(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1));
+        JOBOBJECT_ASSOCIATE_COMPLETION_PORT port = {};
+        port.CompletionKey = hJob.get();
+        port.CompletionPort = hPort.get();
+        if (!hPort.get() ||
+            !SetInformationJobObject(hJob.get(), JobObjectAssociateCompletionPortInformation, &port, sizeof(port))) {
+            PrintError(_T("Failed to associate the accounting job with a completion port."));
+            return;
+        }
+
+        // The tree may have exited before the port was associated, in which case
+        // no message will come.
+        JOBOBJECT_BASIC_ACCOUNTING_INFORMATION active = {};
+        bool running = !QueryInformationJobObject(hJob.get(), JobObjectBasicAccountingInformation,
+            &active, sizeof(active), nullptr) || active.ActiveProcesses > 0;
+        DWORD message = 0;
+        ULONG_PTR key = 0;
+        LPOVERLAPPED overlapped = nullptr;
+        while (running) {
+            if (!GetQueuedCompletionStatus(hPort.get(), &message, &key, &overlapped, INFINITE)) {
+                PrintError(_T("GetQueuedCompletionStatus failed; resource accounting incomplete."));
+                break;
+            }
+            if (key == reinterpret_cast<ULONG_PTR>(hJob.get()) && message == JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO)
+                running = false;
+        }
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        ULONGLONG wallMs = (LaunchCoalescer::FileTimeToULongLong(now) - rootCreationTime) / 10000;
+
+        JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION totals = {};
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+        if (!QueryInformationJobObject(hJob.get(), JobObjectBasicAndIoAccountingInformation,
+                &totals, sizeof(totals), nullptr) ||
+            !QueryInformationJobObject(hJob.get(), JobObjectExtendedLimitInformation,
+                &limits, sizeof(limits), nullptr)) {
+            PrintError(_T("QueryInformationJobObject failed."));
+            return;
+        }
+
+        // Times are in 100 ns units; peak memory is the job's peak committed memory.
+        std::wstring record = L"Resource accounting: pid=" + std::to_wstring(rootProcessId)
+            + L" wall_ms=" + std::to_wstring(wallMs)
+            + L" user_cpu_ms=" + std::to_wstring(totals.BasicInfo.TotalUserTime.QuadPart / 10000)
+            + L" kernel_cpu_ms=" + std::to_wstring(totals.BasicInfo.TotalKernelTime.QuadPart / 10000)
+            + L" peak_memory_kb=" + std::to_wstring(limits.PeakJobMemoryUsed / 1024)
+            + L" read_bytes=" + std::to_wstring(totals.IoInfo.ReadTransferCount)
+            + L" write_bytes=" + std::to_wstring(totals.IoInfo.WriteTransferCount)
+            + L" other_io_bytes=" + std::to_wstring(totals.IoInfo.OtherTransferCount)
+            + L" processes=" + std::to_wstring(totals.BasicInfo.TotalProcesses);
+        LogMessage(record);
+        ConsoleOut(record);
+    }
+
+private:
+    HandleWrapper hJob;
+    DWORD rootProcessId = 0;
+    ULONGLONG rootCreationTime = 0;     // FILETIME units.
+    bool assigned = false;
+};
+
+// Entry point of the accounting watcher: "/accounting-watcher <job handle> <pid> <creation time>".
+int RunAccountingWatcher(int argc, TCHAR* argv[]) {
+    if (argc != 5) {
+        LogMessage(L"Accounting watcher: invalid arguments.");
+        return 1;
+    }
+    LaunchAccounting accounting;
+    accounting.Adopt(reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(_tcstoui64(argv[2], nullptr, 10))),
+        _tcstoul(argv[3], nullptr, 10), _tcstoui64(argv[4], nullptr, 10));
+    accounting.WaitAndReport();
+    return 0;
+}
+
 int _tmain(int argc, TCHAR* argv[])
 {
+    TraceSession traceSession("ServiceUIClone", "serviceui");
     try {
         bool waitForProcess = false;
+        bool accountResources = false;
+        DWORD dedupWindowMs = 0;
+        DWORD maxInFlight = 0;
+        double ratePerSecond = 0.0;
+        double weight = 1.0;
+        std::wstring flowTag;
         int argStart = 1;
 
-        // Optionally support a "/wait" or "-wait" flag as the first argument.
-        if (argc > 1 &&
-            (_tcscmp(argv[1], _T("/wait")) == 0 || _tcscmp(argv[1], _T("-wait")) == 0)) {
-            waitForProcess = true;
-            argStart = 2;
+        if (argc > 1 && _tcscmp(argv[1], ACCOUNTING_WATCHER_SWITCH) == 0)
+            return RunAccountingWatcher(argc, argv);
+
+        // Optional leading flags: "/wait", "/account", "/dedup:<ms>", "/maxinflight:<n>",
+        // "/rate:<n>", "/weight:<n>" and "/flow:<tag>" (each may also start with '-').
+        while (argStart < argc) {
+            const TCHAR* arg = argv[argStart];
+            if (_tcscmp(arg, _T("/wait")) == 0 || _tcscmp(arg, _T("-wait")) == 0) {
+                waitForProcess = true;
+            }
+            else if (_tcscmp(arg, _T("/account")) == 0 || _tcscmp(arg, _T("-account")) == 0) {
+                accountResources = true;
+            }
+            else if (_tcsncmp(arg, _T("/dedup:"), 7) == 0 || _tcsncmp(arg, _T("-dedup:"), 7) == 0) {
+                dedupWindowMs = _tcstoul(arg + 7, nullptr, 10);
+            }
+            else if (_tcsncmp(arg, _T("/maxinflight:"), 13) == 0 || _tcsncmp(arg, _T("-maxinflight:"), 13) == 0) {
+                maxInFlight = _tcstoul(arg + 13, nullptr, 10);
+            }
+            else if (_tcsncmp(arg, _T("/rate:"), 6) == 0 || _tcsncmp(arg, _T("-rate:"), 6) == 0) {
+                ratePerSecond = _tcstod(arg + 6, nullptr);
+            }
+            else if (_tcsncmp(arg, _T("/weight:"), 8) == 0 || _tcsncmp(arg, _T("-weight:"), 8) == 0) {
+                weight = _tcstod(arg + 8, nullptr);
+            }
+            else if (_tcsncmp(arg, _T("/flow:"), 6) == 0 || _tcsncmp(arg, _T("-flow:"), 6) == 0) {
+                flowTag = arg + 6;
+            }
+            else {
+                break;
+            }
+            ++argStart;
         }
 
-        // Validate input: at least one argument (after optional /wait) is required.
+        // Validate input: at least one argument (after optional flags) is required.
         if (argc < argStart + 1) {
-            std::wcerr << _T("Usage: ServiceUIClone.exe [/wait] <command line to launch>") << std::endl;
+            ConsoleErr(L"Usage: ServiceUIClone.exe [/wait] [/account] [/dedup:<ms>] [/maxinflight:<n>] [/rate:<n>] [/weight:<n>] [/flow:<tag>] <command line to launch>");
             LogMessage(L"Insufficient arguments provided.");
             return 1;
         }
@@ -136,15 +859,14 @@ int _tmain(int argc, TCHAR* argv[])
         // Trim the combined command line.
         commandLine = Trim(commandLine);
         if (commandLine.empty()) {
-            std::wcerr << _T("Error: The command line is empty after trimming.") << std::endl;
+            ConsoleErr(L"Error: The command line is empty after trimming.");
             LogMessage(L"Empty command line after trimming.");
             return 1;
         }
 
         // Optionally, enforce a maximum length.
-        const size_t MAX_CMDLINE_LENGTH = 1024;
         if (commandLine.size() > MAX_CMDLINE_LENGTH) {
-            std::wcerr << _T("Error: Command line exceeds maximum allowed length.") << std::endl;
+            ConsoleErr(L"Error: Command line exceeds maximum allowed length.");
             LogMessage(L"Command line too long.");
             return 1;
         }
@@ -164,10 +886,41 @@ int _tmain(int argc, TCHAR* argv[])
             PrintError(_T("Failed to get active console session ID."));
             return 1;
         }
-        {
-            std::wstringstream ss;
-            ss << L"Active console session ID: " << sessionId;
-            LogMessage(ss.str());
+        LogMessage(L"Active console session ID: " + std::to_wstring(sessionId));
+
+        // Coalesce with an identical launch into the same session, if requested.
+        LaunchCoalescer coalescer;
+        if (dedupWindowMs > 0) {
+            LaunchCoalescer::Role role = coalescer.Join(sessionId, commandLine, dedupWindowMs);
+            if (role == LaunchCoalescer::Role::Follower) {
+                if (!coalescer.LaunchSucceededForFollower()) {
+                    SetLastError(coalescer.Error());
+                    PrintError(_T("Coalesced launch failed."));
+                    return 1;
+                }
+                {
+                    std::wstring coalesced = L"Coalesced with in-flight launch in session " + std::to_wstring(sessionId)
+                        + L". Process ID: " + std::to_wstring(coalescer.ProcessId());
+                    LogMessage(coalesced);
+                    ConsoleOut(coalesced);
+                }
+                if (waitForProcess) {
+                    DWORD exitCode = 0;
+                    if (!coalescer.WaitForExit(exitCode)) {
+                        ConsoleErr(L"Error: Could not obtain the exit code of the coalesced launch.");
+                        LogMessage(L"Could not obtain the exit code of the coalesced launch.");
+                        return 1;
+                    }
+                    std::wstring exited = L"Launched process exited with code: " + std::to_wstring(exitCode);
+                    LogMessage(exited);
+                    ConsoleOut(exited);
+                    return exitCode;
+                }
+                return 0;
+            }
+            LogMessage(role == LaunchCoalescer::Role::Leader
+                ? L"No duplicate launch in flight; leading this launch."
+                : L"Launch coalescing unavailable; launching independently.");
         }
 
         // Step 2: Open the current process token (should be SYSTEM).
@@ -220,10 +973,30 @@ int _tmain(int argc, TCHAR* argv[])
         }
         LogMessage(L"Required privileges enabled successfully.");
 
-        // Step 6: Prepare STARTUPINFO and PROCESS_INFORMATION.
+        // Wait for admission if launches are throttled. The slot is held until the
+        // new process has finished starting up.
+        LaunchAdmission admission;
+        bool throttled = false;
+        if (maxInFlight > 0 || ratePerSecond > 0.0) {
+            std::wstring flowName = CallerFlowName(flowTag);
+            LogMessage(L"Admission flow: " + flowName);
+            throttled = admission.Admit(FlowKey(flowName), maxInFlight, ratePerSecond, weight);
+        }
+
+        // Step 6: Resolve the user's environment, profile directory and desktop.
+        UserLaunchContextSource launchContextSource;
+        SharedLaunchContextCache launchContextCache;
+        std::unique_ptr<LaunchContext> launchContext = launchContextCache.Get(sessionId, launchContextSource);
+        if (!launchContext) {
+            LogMessage(L"No launch context for the session; using the SYSTEM environment and directory.");
+        }
+
+        // Step 7: Prepare STARTUPINFO and PROCESS_INFORMATION.
         STARTUPINFO si = {};
         si.cb = sizeof(si);
-        si.lpDesktop = const_cast<LPTSTR>(_T("winsta0\\default"));
+        si.lpDesktop = launchContext
+            ? const_cast<LPTSTR>(launchContext->desktop.c_str())
+            : const_cast<LPTSTR>(_T("winsta0\\default"));
 
         PROCESS_INFORMATION pi = {};
 
@@ -234,47 +1007,106 @@ int _tmain(int argc, TCHAR* argv[])
 
         LogMessage(L"Attempting to launch process with CreateProcessAsUser.");
 
-        // Step 7: Create the process using the modified SYSTEM token.
-        BOOL result = CreateProcessAsUser(
-            hDupToken.get(),    // SYSTEM token adjusted to active session.
-            nullptr,            // Application name (NULL when using command line).
-            cmdLine,            // Command line to execute.
-            nullptr,            // Process security attributes.
-            nullptr,            // Thread security attributes.
-            FALSE,              // Do not inherit handles.
-            0,                  // No creation flags.
-            nullptr,            // Use parent's environment.
-            nullptr,            // Use parent's current directory.
-            &si,                // STARTUPINFO.
-            &pi                 // PROCESS_INFORMATION.
-        );
+        LPVOID environment = (launchContext && !launchContext->environment.empty())
+            ? &launchContext->environment[0] : nullptr;
+        LPCTSTR currentDirectory = (launchContext && !launchContext->profileDirectory.empty())
+            ? launchContext->profileDirectory.c_str() : nullptr;
+
+        // Hand the trace on to the child so that one trace covers the whole chain.
+        uint64_t launchFlow = TraceNewFlowId();
+        std::wstring tracedEnvironment;
+        if (launchFlow) {
+            tracedEnvironment = TraceEnvironmentForChild(environment, launchFlow);
+            environment = &tracedEnvironment[0];
+        }
+
+        // With /account the child starts suspended so it can join the accounting job first.
+        LaunchAccounting accounting;
+        bool accounted = accountResources && accounting.Create();
+        DWORD creationFlags = (environment ? CREATE_UNICODE_ENVIRONMENT : 0) | (accounted ? CREATE_SUSPENDED : 0);
+
+        // Step 8: Create the process using the modified SYSTEM token.
+        BOOL result = FALSE;
+        {
+            TraceSpan span("CreateProcessAsUser");
+            TraceFlowStart("launch", launchFlow);
+            result = CreateProcessAsUser(
+                hDupToken.get(),    // SYSTEM token adjusted to active session.
+                nullptr,            // Application name (NULL when using command line).
+                cmdLine,            // Command line to execute.
+                nullptr,            // Process security attributes.
+                nullptr,            // Thread security attributes.
+                FALSE,              // Do not inherit handles.
+                creationFlags,      // Unicode environment; suspended for accounting.
+                environment,        // User's environment (parent's if unavailable).
+                currentDirectory,   // User's profile directory (parent's if unavailable).
+                &si,                // STARTUPINFO.
+                &pi                 // PROCESS_INFORMATION.
+            );
+        }
 
         delete[] cmdLine;
 
         if (!result) {
+            DWORD launchError = GetLastError();
+            coalescer.Publish(nullptr, 0, 0, launchError);
+            SetLastError(launchError);
             PrintError(_T("CreateProcessAsUser failed."));
             return 1;
         }
 
+        FILETIME creation = {}, exitTime, kernel, user;
+        GetProcessTimes(pi.hProcess, &creation, &exitTime, &kernel, &user);
+        ULONGLONG creationTime = LaunchCoalescer::FileTimeToULongLong(creation);
+
+        if (accounted) {
+            if (!accounting.Assign(pi.hProcess, pi.dwProcessId, creationTime)) {
+                PrintError(_T("AssignProcessToJobObject failed; resource accounting disabled."));
+            }
+            // A child that cannot be resumed would stay suspended forever.
+            if (ResumeThread(pi.hThread) == static_cast<DWORD>(-1)) {
+                DWORD resumeError = GetLastError();
+                TerminateProcess(pi.hProcess, 1);
+                coalescer.Publish(nullptr, 0, 0, resumeError);
+                SetLastError(resumeError);
+                PrintError(_T("ResumeThread failed; the launched process was terminated."));
+                CloseHandle(pi.hProcess);
+                CloseHandle(pi.hThread);
+                return 1;
+            }
+        }
+
+        coalescer.Publish(pi.hProcess, pi.dwProcessId, creationTime, ERROR_SUCCESS);
+        launchContextCache.HandTo(pi.hProcess);
+
+        if (throttled) {
+            WaitForInputIdle(pi.hProcess, ADMISSION_STARTUP_TIMEOUT_MS);
+            admission.Release();
+        }
+
         {
-            std::wstringstream ss;
-            ss << L"Process launched successfully in session " << sessionId
-                << L". Process ID: " << pi.dwProcessId;
-            LogMessage(ss.str());
-            std::wcout << ss.str() << std::endl;
+            std::wstring launched = L"Process launched successfully in session " + std::to_wstring(sessionId)
+                + L". Process ID: " + std::to_wstring(pi.dwProcessId);
+            LogMessage(launched);
+            ConsoleOut(launched);
         }
 
         // If /wait flag was specified, wait for the process to terminate.
         if (waitForProcess) {
             LogMessage(L"Waiting for the launched process to exit...");
-            DWORD waitResult = WaitForSingleObject(pi.hProcess, INFINITE);
+            DWORD waitResult = WAIT_FAILED;
+            {
+                TraceSpan span("WaitForProcess");
+                waitResult = WaitForSingleObject(pi.hProcess, INFINITE);
+            }
             if (waitResult == WAIT_OBJECT_0) {
                 DWORD exitCode = 0;
                 if (GetExitCodeProcess(pi.hProcess, &exitCode)) {
-                    std::wstringstream ss;
-                    ss << L"Launched process exited with code: " << exitCode;
-                    LogMessage(ss.str());
-                    std::wcout << ss.str() << std::endl;
+                    coalescer.PublishExit(exitCode);
+                    std::wstring exited = L"Launched process exited with code: " + std::to_wstring(exitCode);
+                    LogMessage(exited);
+                    ConsoleOut(exited);
+                    accounting.WaitAndReport();
                     // Close handles before returning.
                     CloseHandle(pi.hProcess);
                     CloseHandle(pi.hThread);
@@ -289,13 +1121,18 @@ int _tmain(int argc, TCHAR* argv[])
             }
         }
 
+        // Without /wait (or if waiting failed) the launcher does not stay behind
+        // for the accounting; a detached watcher reports when the tree exits.
+        accounting.HandOff();
+
         // Clean up process and thread handles.
         CloseHandle(pi.hProcess);
         CloseHandle(pi.hThread);
     }
     catch (const std::exception& ex) {
-        std::wcerr << _T("Exception: ") << ex.what() << std::endl;
-        LogMessage(std::wstring(L"Exception: ") + std::wstring(ex.what(), ex.what() + strlen(ex.what())));
+        std::wstring error = std::wstring(L"Exception: ") + std::wstring(ex.what(), ex.what() + strlen(ex.what()));
+        ConsoleErr(error);
+        LogMessage(error);
         return 1;
     }
     return 0;
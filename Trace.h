@@ -0,0 +1,327 @@
+#pragma once
+
+// Lightweight tracing shared by ServiceUIClone and BitLockerPINUI, enabled when
+// SERVICEUICLONE_TRACE names a trace file. Every process in a launch chain appends
+// its events to that file in Chrome trace-event JSON array format. Each thread
+// records into its own fixed-size buffer without locking; the buffers are written
+// out when the process ends.
+//
+// Events are stamped with the processor's time-stamp counter where there is one,
+// which is cheaper to read than the performance counter. Each process maps its
+// counter readings onto the performance counter, which all processes share, when
+// it exports, so events from different processes still line up.
+//
+// The Windows build is the one that ships. The POSIX branches only exist so the
+// recording path can be measured on any machine (see tests/TraceOverheadBench.cpp).
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <cstdlib>
+#endif
+#include <string>
+#include <atomic>
+#include <new>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRACE_USE_TSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+const uint32_t TRACE_BUFFER_CAPACITY = 8192;
+
+struct TraceEvent {
+    const char* name;               // Static string.
+    char phase;                     // 'X' span, 'i' instant, 's'/'f' flow start/end.
+    int64_t timestamp;              // Ticks, see TraceNow.
+    int64_t duration;
+    uint64_t id;                    // Flow ID for 's'/'f'.
+};
+
+struct TraceBuffer {
+    TraceEvent events[TRACE_BUFFER_CAPACITY];
+    std::atomic<uint32_t> count{ 0 };
+    uint32_t dropped = 0;
+    unsigned long threadId = 0;
+    TraceBuffer* next = nullptr;
+};
+
+struct TraceState {
+    bool enabled = false;           // Set once, before any other thread starts.
+#ifdef _WIN32
+    std::wstring path;
+    LARGE_INTEGER frequency = {};
+#else
+    std::string path;
+#endif
+    int64_t anchorTicks = 0;        // TraceNow() and TraceClockNow() read together,
+    int64_t anchorClock = 0;        // when the session starts.
+    double clockPerTick = 1.0;      // Shared clock ticks per TraceNow() tick.
+    const char* category = "";      // "cat" of every event this process writes.
+    uint64_t parentFlow = 0;        // From SERVICEUICLONE_TRACE_PARENT.
+    std::atomic<TraceBuffer*> buffers{ nullptr };
+    std::atomic<uint32_t> nextFlow{ 0 };
+    std::atomic<unsigned long> nextThread{ 0 };
+};
+
+inline TraceState g_trace;
+inline thread_local TraceBuffer* t_traceBuffer = nullptr;
+
+inline unsigned long TraceProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+
+// Raw ticks of the performance counter, which is shared by all processes.
+inline int64_t TraceClockNow() {
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
+
+inline long long TraceClockMicroseconds(int64_t clock) {
+#ifdef _WIN32
+    int64_t freq = g_trace.frequency.QuadPart;
+    return clock / freq * 1000000 + clock % freq * 1000000 / freq;
+#else
+    return clock / 1000;
+#endif
+}
+
+// Event timestamps: the time-stamp counter where there is one, otherwise the
+// shared clock. Events store ticks; they are converted to microseconds only
+// when exported.
+inline int64_t TraceNow() {
+#ifdef TRACE_USE_TSC
+    return static_cast<int64_t>(__rdtsc());
+#else
+    return TraceClockNow();
+#endif
+}
+
+// Pins TraceNow() to the shared clock at the start of the session.
+inline void TraceAnchor() {
+    g_trace.anchorTicks = TraceNow();
+    g_trace.anchorClock = TraceClockNow();
+    g_trace.clockPerTick = 1.0;
+}
+
+// Measures the rate of TraceNow() against the shared clock since TraceAnchor().
+// Called once, before the events are exported.
+inline void TraceCalibrate() {
+#ifdef TRACE_USE_TSC
+    int64_t ticks = TraceNow() - g_trace.anchorTicks;
+    int64_t clock = TraceClockNow() - g_trace.anchorClock;
+    if (ticks > 0 && clock > 0)
+        g_trace.clockPerTick = static_cast<double>(clock) / ticks;
+#endif
+}
+
+// A TraceNow() reading as microseconds on the shared clock.
+inline long long TraceMicroseconds(int64_t ticks) {
+#ifdef TRACE_USE_TSC
+    return TraceClockMicroseconds(g_trace.anchorClock +
+        llround((ticks - g_trace.anchorTicks) * g_trace.clockPerTick));
+#else
+    return TraceClockMicroseconds(ticks);
+#endif
+}
+
+// A difference of TraceNow() readings as microseconds.
+inline long long TraceDurationMicroseconds(int64_t ticks) {
+    return TraceClockMicroseconds(llround(ticks * g_trace.clockPerTick));
+}
+
+inline void TraceRecord(const char* name, char phase, int64_t timestamp, int64_t duration, uint64_t id) {
+    TraceBuffer* buffer = t_traceBuffer;
+    if (!buffer) {
+        buffer = new (std::nothrow) TraceBuffer();
+        if (!buffer)
+            return;
+#ifdef _WIN32
+        buffer->threadId = GetCurrentThreadId();
+#else
+        buffer->threadId = ++g_trace.nextThread;
+#endif
+        buffer->next = g_trace.buffers.load();
+        while (!g_trace.buffers.compare_exchange_weak(buffer->next, buffer)) {
+        }
+        t_traceBuffer = buffer;
+    }
+    uint32_t n = buffer->count.load(std::memory_order_relaxed);
+    if (n >= TRACE_BUFFER_CAPACITY) {
+        ++buffer->dropped;
+        return;
+    }
+    buffer->events[n] = { name, phase, timestamp, duration, id };
+    buffer->count.store(n + 1, std::memory_order_release);
+}
+
+// Records a complete event covering the scope.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : name(name), start(g_trace.enabled ? TraceNow() : 0) {}
+    ~TraceSpan() {
+        if (g_trace.enabled)
+            TraceRecord(name, 'X', start, TraceNow() - start, 0);
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+private:
+    const char* name;
+    int64_t start;
+};
+
+// Records a point in time: one clock read, against two for a span. Used on
+// paths too short for a span to stay within the overhead budget.
+inline void TraceInstant(const char* name) {
+    if (g_trace.enabled)
+        TraceRecord(name, 'i', TraceNow(), 0, 0);
+}
+
+// Allocates the ID of a flow towards a child process, to pass on in
+// SERVICEUICLONE_TRACE_PARENT. Returns 0 if tracing is off.
+inline uint64_t TraceNewFlowId() {
+    if (!g_trace.enabled)
+        return 0;
+    return (static_cast<uint64_t>(TraceProcessId()) << 32) | ++g_trace.nextFlow;
+}
+
+// Records the start of a flow. Call it inside the span that creates the child,
+// so the arrow leaves from that span.
+inline void TraceFlowStart(const char* name, uint64_t id) {
+    if (g_trace.enabled && id)
+        TraceRecord(name, 's', TraceNow(), 0, id);
+}
+
+// Reads the trace settings from the environment on construction and appends
+// the process's events to the trace file on destruction.
+class TraceSession {
+public:
+    TraceSession(const char* processName, const char* category) : processName(processName) {
+        g_trace.category = category;
+#ifdef _WIN32
+        DWORD size = GetEnvironmentVariableW(L"SERVICEUICLONE_TRACE", nullptr, 0);
+        if (size == 0)
+            return;
+        g_trace.path.resize(size);
+        g_trace.path.resize(GetEnvironmentVariableW(L"SERVICEUICLONE_TRACE", &g_trace.path[0], size));
+        WCHAR parent[32] = {};
+        if (GetEnvironmentVariableW(L"SERVICEUICLONE_TRACE_PARENT", parent, 32) > 0)
+            g_trace.parentFlow = _wcstoui64(parent, nullptr, 16);
+        QueryPerformanceFrequency(&g_trace.frequency);
+#else
+        const char* path = getenv("SERVICEUICLONE_TRACE");
+        if (!path)
+            return;
+        g_trace.path = path;
+        const char* parent = getenv("SERVICEUICLONE_TRACE_PARENT");
+        if (parent)
+            g_trace.parentFlow = strtoull(parent, nullptr, 16);
+#endif
+        g_trace.enabled = !g_trace.path.empty();
+        if (g_trace.enabled)
+            TraceAnchor();
+        start = g_trace.enabled ? TraceNow() : 0;
+        if (g_trace.enabled && g_trace.parentFlow)
+            TraceRecord("launch", 'f', start, 0, g_trace.parentFlow);
+    }
+
+    ~TraceSession() {
+        if (!g_trace.enabled)
+            return;
+        TraceRecord(processName, 'X', start, TraceNow() - start, 0);
+        TraceCalibrate();
+        Export();
+        g_trace.enabled = false;
+    }
+
+    TraceSession(const TraceSession&) = delete;
+    TraceSession& operator=(const TraceSession&) = delete;
+
+private:
+    void Export() const {
+        unsigned long pid = TraceProcessId();
+        const char* cat = g_trace.category;
+        std::string out;
+        char line[320];
+        snprintf(line, sizeof(line),
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":0,\"args\":{\"name\":\"%s\"}},\n",
+            pid, processName);
+        out += line;
+        for (TraceBuffer* buffer = g_trace.buffers.load(); buffer; buffer = buffer->next) {
+            unsigned long tid = buffer->threadId;
+            uint32_t count = buffer->count.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < count; ++i) {
+                const TraceEvent& e = buffer->events[i];
+                if (e.phase == 'X') {
+                    snprintf(line, sizeof(line),
+                        "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%lu,\"tid\":%lu},\n",
+                        e.name, cat, TraceMicroseconds(e.timestamp), TraceDurationMicroseconds(e.duration), pid, tid);
+                }
+                else if (e.phase == 'i') {
+                    snprintf(line, sizeof(line),
+                        "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":%lu,\"tid\":%lu},\n",
+                        e.name, cat, TraceMicroseconds(e.timestamp), pid, tid);
+                }
+                else {
+                    snprintf(line, sizeof(line),
+                        "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"bp\":\"e\",\"id\":\"0x%llx\",\"ts\":%lld,\"pid\":%lu,\"tid\":%lu},\n",
+                        e.name, cat, e.phase, static_cast<unsigned long long>(e.id), TraceMicroseconds(e.timestamp), pid, tid);
+                }
+                out += line;
+            }
+            if (buffer->dropped) {
+                snprintf(line, sizeof(line),
+                    "{\"name\":\"trace buffer full\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":%lu,\"tid\":%lu,\"args\":{\"dropped\":%u}},\n",
+                    cat, TraceMicroseconds(TraceNow()), pid, tid, buffer->dropped);
+                out += line;
+            }
+        }
+
+        // One append per process. The closing ']' is optional in the array format,
+        // so processes can keep appending to the same file.
+#ifdef _WIN32
+        HANDLE hFile = CreateFileW(g_trace.path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER fileSize = {};
+        if (GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart == 0)
+            out.insert(0, "[\n");
+        DWORD written = 0;
+        WriteFile(hFile, out.data(), static_cast<DWORD>(out.size()), &written, nullptr);
+        CloseHandle(hFile);
+#else
+        FILE* file = fopen(g_trace.path.c_str(), "ab");
+        if (!file)
+            return;
+        fseek(file, 0, SEEK_END);
+        if (ftell(file) == 0)
+            out.insert(0, "[\n");
+        fwrite(out.data(), 1, out.size(), file);
+        fclose(file);
+#endif
+    }
+
+    const char* processName;
+    int64_t start = 0;
+};
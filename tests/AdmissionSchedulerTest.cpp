@@ -0,0 +1,243 @@
+// Tests for the admission scheduling core (token bucket, in-flight cap, weighted
+// fair queueing, queue-full behavior, reaping and the wake protocol), plus a
+// timing run with the queue at capacity. The core is plain data, so this builds anywhere:
+//
+//   g++ -std=c++17 -O2 -I.. AdmissionSchedulerTest.cpp -o AdmissionSchedulerTest
+//   cl /std:c++17 /O2 /EHsc /I.. AdmissionSchedulerTest.cpp
+
+#include "AdmissionScheduler.h"
+#include "Check.h"
+#include <chrono>
+#include <memory>
+#include <vector>
+
+std::unique_ptr<AdmissionState> NewState(uint32_t maxInFlight, double ratePerSecond) {
+    std::unique_ptr<AdmissionState> state(new AdmissionState());
+    AdmissionScheduler::Configure(*state, maxInFlight, ratePerSecond, 0);
+    return state;
+}
+
+AdmissionOwner Owner(uint32_t id) {
+    return { id, 1000 + id };
+}
+
+// Admits the head waiter, releases it straight away and returns its flow.
+uint32_t AdmitHead(AdmissionState& state, uint64_t nowMs) {
+    int head = AdmissionScheduler::Head(state);
+    if (head < 0 || !AdmissionScheduler::TryAdmit(state, head, nowMs))
+        return 0;
+    uint32_t flow = state.waiters[head].flowKey;
+    AdmissionScheduler::Release(state, state.waiters[head].owner);
+    return flow;
+}
+
+void TestInFlightCap() {
+    auto state = NewState(2, 0.0);
+    int a = AdmissionScheduler::Enqueue(*state, Owner(1), 1, 1.0, 0);
+    int b = AdmissionScheduler::Enqueue(*state, Owner(2), 2, 1.0, 0);
+    int c = AdmissionScheduler::Enqueue(*state, Owner(3), 3, 1.0, 0);
+    CHECK(AdmissionScheduler::TryAdmit(*state, a, 0));
+    CHECK(AdmissionScheduler::TryAdmit(*state, b, 0));
+    CHECK(!AdmissionScheduler::TryAdmit(*state, c, 0));
+    CHECK(!AdmissionScheduler::HasCapacity(*state, 0));
+    AdmissionScheduler::Release(*state, Owner(1));
+    CHECK(AdmissionScheduler::TryAdmit(*state, c, 0));
+    CHECK(state->inFlightCount == 2);
+    CHECK(state->queueDepth == 0);
+}
+
+void TestTokenBucket() {
+    auto state = NewState(0, 2.0);        // Two per second, burst of two.
+    int slots[3];
+    for (uint32_t i = 0; i < 3; ++i)
+        slots[i] = AdmissionScheduler::Enqueue(*state, Owner(i + 1), 1, 1.0, 0);
+    CHECK(AdmissionScheduler::TryAdmit(*state, slots[0], 0));
+    CHECK(AdmissionScheduler::TryAdmit(*state, slots[1], 0));
+    CHECK(!AdmissionScheduler::TryAdmit(*state, slots[2], 0));
+    CHECK(AdmissionScheduler::RetryDelayMs(*state) == 501);
+    CHECK(!AdmissionScheduler::TryAdmit(*state, slots[2], 400));
+    CHECK(AdmissionScheduler::TryAdmit(*state, slots[2], 500));
+}
+
+// A flow that arrives behind a long backlog from another flow must not wait
+// for the whole backlog.
+void TestFairness() {
+    auto state = NewState(1, 0.0);
+    for (uint32_t i = 0; i < 20; ++i)
+        AdmissionScheduler::Enqueue(*state, Owner(i + 1), 1, 1.0, i);
+    AdmissionScheduler::Enqueue(*state, Owner(100), 2, 1.0, 50);
+    int position = -1;
+    for (int i = 0; i < 21; ++i) {
+        if (AdmitHead(*state, 100) == 2) {
+            position = i;
+            break;
+        }
+    }
+    CHECK(position >= 0 && position <= 1);
+}
+
+// With both flows backlogged, admissions follow the 3:1 weights.
+void TestWeights() {
+    auto state = NewState(1, 0.0);
+    for (uint32_t i = 0; i < 60; ++i) {
+        AdmissionScheduler::Enqueue(*state, Owner(i + 1), 1, 3.0, 0);
+        AdmissionScheduler::Enqueue(*state, Owner(i + 1001), 2, 1.0, 0);
+    }
+    uint32_t heavy = 0, light = 0;
+    for (int i = 0; i < 40; ++i) {
+        uint32_t flow = AdmitHead(*state, 1);
+        heavy += flow == 1;
+        light += flow == 2;
+    }
+    CHECK(heavy == 30);
+    CHECK(light == 10);
+}
+
+void TestQueueFull() {
+    auto state = NewState(1, 0.0);
+    for (uint32_t i = 0; i < ADMISSION_MAX_WAITERS; ++i)
+        CHECK(AdmissionScheduler::Enqueue(*state, Owner(i + 1), i % 8 + 1, 1.0, 0) >= 0);
+    CHECK(AdmissionScheduler::Enqueue(*state, Owner(99999), 1, 1.0, 0) == -1);
+    CHECK(state->queueFullWaits == 1);
+    CHECK(AdmitHead(*state, 0) != 0);
+    CHECK(AdmissionScheduler::Enqueue(*state, Owner(99999), 1, 1.0, 0) >= 0);
+}
+
+// A reused process ID (same ID, different creation time) counts as dead.
+void TestReap() {
+    auto state = NewState(4, 0.0);
+    int a = AdmissionScheduler::Enqueue(*state, Owner(1), 1, 1.0, 0);
+    AdmissionScheduler::Enqueue(*state, Owner(2), 1, 1.0, 0);
+    AdmissionScheduler::Enqueue(*state, Owner(3), 1, 1.0, 0);
+    CHECK(AdmissionScheduler::TryAdmit(*state, a, 0));
+    CHECK(!AdmissionScheduler::ReapDue(*state, ADMISSION_REAP_INTERVAL_MS - 1));
+    CHECK(AdmissionScheduler::ReapDue(*state, ADMISSION_REAP_INTERVAL_MS));
+
+    AdmissionOwner live = { 3, 1003 };
+    AdmissionScheduler::Reap(*state, [&live](const AdmissionOwner& owner) { return owner == live; },
+        ADMISSION_REAP_INTERVAL_MS);
+    CHECK(state->inFlightCount == 0);
+    CHECK(state->queueDepth == 1);
+    CHECK(!AdmissionScheduler::ReapDue(*state, ADMISSION_REAP_INTERVAL_MS + 1));
+}
+
+// Runs count launchers queued at time 0 through the LaunchAdmission wait loop on
+// a virtual clock and returns when each was admitted. A launcher sleeps until
+// its event is set or its delay passes, and holds its in-flight slot for holdMs.
+std::vector<uint64_t> SimulateLaunchers(AdmissionState& state, uint32_t count, uint64_t holdMs) {
+    struct Launcher {
+        AdmissionOwner owner;
+        int slot;
+        uint64_t wakeMs;            // Next retry; moved up when woken.
+        uint64_t admittedMs;
+        uint64_t releaseMs;
+        bool admitted;
+        bool released;
+    };
+    std::vector<Launcher> launchers(count);
+    for (uint32_t i = 0; i < count; ++i)
+        launchers[i] = { Owner(i + 1), AdmissionScheduler::Enqueue(state, Owner(i + 1), 1, 1.0, 0), 0, 0, 0, false, false };
+    // Wakes the launcher waiting in slot, as LaunchAdmission::Wake does.
+    auto wake = [&](int slot, uint64_t nowMs) {
+        if (slot >= 0) {
+            Launcher& l = launchers[state.waiters[slot].owner.processId - 1];
+            if (l.wakeMs > nowMs)
+                l.wakeMs = nowMs;
+        }
+    };
+
+    for (int step = 0; step < 10000; ++step) {
+        // The next thing to happen: a launch finishing, or a waiter retrying.
+        Launcher* next = nullptr;
+        bool release = false;
+        uint64_t nowMs = UINT64_MAX;
+        for (Launcher& l : launchers) {
+            if (l.admitted && !l.released && l.releaseMs < nowMs) {
+                next = &l;
+                release = true;
+                nowMs = l.releaseMs;
+            }
+            else if (!l.admitted && l.wakeMs < nowMs) {
+                next = &l;
+                release = false;
+                nowMs = l.wakeMs;
+            }
+        }
+        if (!next)
+            break;
+        if (release) {
+            next->released = true;
+            AdmissionScheduler::Release(state, next->owner);
+            wake(AdmissionScheduler::Head(state), nowMs);
+        }
+        else if (AdmissionScheduler::TryAdmit(state, next->slot, nowMs)) {
+            next->admitted = true;
+            next->admittedMs = nowMs;
+            next->releaseMs = nowMs + holdMs;
+            wake(AdmissionScheduler::Head(state), nowMs);
+        }
+        else {
+            int slot = -1;
+            uint64_t delay = AdmissionScheduler::WaitMs(state, next->slot, nowMs, slot);
+            next->wakeMs = nowMs + delay;
+            wake(slot, nowMs);
+        }
+    }
+    std::vector<uint64_t> admittedMs;
+    for (const Launcher& l : launchers)
+        admittedMs.push_back(l.admitted ? l.admittedMs : UINT64_MAX);
+    return admittedMs;
+}
+
+// Under a rate limit each launcher is admitted about one token after the last,
+// not after the reap interval: an admission that empties the bucket still wakes
+// the new head, which then waits for the next token.
+void TestWakeHandoff() {
+    auto state = NewState(0, 2.0);
+    std::vector<uint64_t> admittedMs = SimulateLaunchers(*state, 5, 0);
+    CHECK(admittedMs[0] == 0 && admittedMs[1] == 0);
+    CHECK(admittedMs[2] <= 600);
+    CHECK(admittedMs[3] <= 1100);
+    CHECK(admittedMs[4] <= 1600);
+
+    // The same when a release frees an in-flight slot while the bucket is empty.
+    state = NewState(1, 2.0);
+    admittedMs = SimulateLaunchers(*state, 5, 100);
+    CHECK(admittedMs[1] <= 200);
+    CHECK(admittedMs[2] <= 600);
+    CHECK(admittedMs[3] <= 1100);
+    CHECK(admittedMs[4] <= 1600);
+    CHECK(state->inFlightCount == 0);
+}
+
+// Admission cost with the queue at capacity, as under a logon storm.
+void BenchmarkFullQueue() {
+    auto state = NewState(ADMISSION_MAX_IN_FLIGHT, 0.0);
+    uint32_t next = 1;
+    for (uint32_t i = 0; i < ADMISSION_MAX_WAITERS; ++i, ++next)
+        AdmissionScheduler::Enqueue(*state, Owner(next), next % 32 + 1, 1.0 + next % 3, 0);
+
+    const int ROUNDS = 20000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; ++i, ++next) {
+        AdmitHead(*state, i);
+        AdmissionScheduler::Enqueue(*state, Owner(next), next % 32 + 1, 1.0 + next % 3, i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(state->queueDepth == ADMISSION_MAX_WAITERS);
+    CHECK(state->admitted == static_cast<uint64_t>(ROUNDS));
+    printf("admit + enqueue with %u waiters: %.2f us\n", ADMISSION_MAX_WAITERS,
+        std::chrono::duration<double, std::micro>(elapsed).count() / ROUNDS);
+}
+
+int main() {
+    TestInFlightCap();
+    TestTokenBucket();
+    TestFairness();
+    TestWeights();
+    TestQueueFull();
+    TestReap();
+    TestWakeHandoff();
+    BenchmarkFullQueue();
+    return TestResult();
+}
@@ -0,0 +1,233 @@
+// Tests for BitLockerStatusSnapshot, driven by a fake volume source instead of WMI:
+// initial load, refresh on change events, the slow full refresh that catches
+// changes WMI raises no event for, stopping in the middle of the enumeration,
+// and the failure paths. Builds anywhere:
+//
+//   g++ -std=c++17 -O2 -pthread -I.. BitLockerStatusTest.cpp -o BitLockerStatusTest
+//   cl /std:c++17 /O2 /EHsc /I.. BitLockerStatusTest.cpp
+
+#include "BitLockerStatus.h"
+#include "Check.h"
+#include <atomic>
+
+void LogMessage(const std::wstring&) {}
+
+//
+// FakeVolumeSource: Volumes held in memory. The test changes them with Set and
+// raises change events with Fire, as WMI would.
+//
+struct FakeVolumes
+{
+    std::mutex mutex;
+    std::map<std::wstring, VolumeStatus> volumes;      // By path.
+    std::function<void(const std::wstring&)> onChange;
+    std::chrono::milliseconds enumerateDelay{ 0 };      // Per volume.
+    bool openFails = false;
+    bool subscribeFails = false;
+    std::atomic<int> enumerated{ 0 };
+    std::atomic<int> reads{ 0 };
+    std::atomic<bool> closed{ false };
+
+    void Set(const VolumeStatus& status)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        volumes[status.path] = status;
+    }
+
+    void Fire(const std::wstring& path)
+    {
+        std::function<void(const std::wstring&)> callback;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            callback = onChange;
+        }
+        if (callback)
+            callback(path);
+    }
+};
+
+class FakeVolumeSource : public VolumeStatusSource
+{
+public:
+    explicit FakeVolumeSource(FakeVolumes& fake) : fake(fake) {}
+
+    bool Open() override { return !fake.openFails; }
+    void Close() override
+    {
+        std::lock_guard<std::mutex> lock(fake.mutex);
+        fake.onChange = nullptr;
+        fake.closed = true;
+    }
+
+    bool EnumerateVolumes(const std::function<bool(const VolumeStatus&)>& onVolume) override
+    {
+        std::vector<VolumeStatus> all;
+        {
+            std::lock_guard<std::mutex> lock(fake.mutex);
+            for (const auto& entry : fake.volumes)
+                all.push_back(entry.second);
+        }
+        for (const VolumeStatus& status : all)
+        {
+            std::this_thread::sleep_for(fake.enumerateDelay);
+            ++fake.enumerated;
+            if (!onVolume(status))
+                break;
+        }
+        return true;
+    }
+
+    bool ReadVolume(const std::wstring& path, VolumeStatus& status) override
+    {
+        ++fake.reads;
+        std::lock_guard<std::mutex> lock(fake.mutex);
+        auto it = fake.volumes.find(path);
+        if (it == fake.volumes.end())
+            return false;
+        status = it->second;
+        return true;
+    }
+
+    bool Subscribe(std::function<void(const std::wstring&)> onChange) override
+    {
+        if (fake.subscribeFails)
+            return false;
+        std::lock_guard<std::mutex> lock(fake.mutex);
+        fake.onChange = std::move(onChange);
+        return true;
+    }
+
+private:
+    FakeVolumes& fake;
+};
+
+VolumeStatus MakeVolume(const std::wstring& id, const std::wstring& letter, unsigned int percentage)
+{
+    VolumeStatus status;
+    status.deviceId = id;
+    status.driveLetter = letter;
+    status.path = L"Win32_EncryptableVolume.DeviceID=\"" + id + L"\"";
+    status.protectionStatus = 1;
+    status.encryptionPercentage = percentage;
+    return status;
+}
+
+// Polls condition for up to two seconds.
+template <typename Condition>
+bool WaitFor(Condition condition)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+unsigned int Percentage(const BitLockerStatusSnapshot& snapshot, const std::wstring& letter)
+{
+    VolumeStatus status;
+    return snapshot.Lookup(letter, status) ? status.encryptionPercentage : 1000;
+}
+
+void TestLoadAndEvents()
+{
+    FakeVolumes fake;
+    fake.Set(MakeVolume(L"vol-c", L"C:", 40));
+    fake.Set(MakeVolume(L"vol-d", L"D:", 100));
+    std::atomic<int> notifications{ 0 };
+    BitLockerStatusSnapshot snapshot(std::chrono::hours(1));
+    snapshot.Start(std::unique_ptr<VolumeStatusSource>(new FakeVolumeSource(fake)), [&] { ++notifications; });
+
+    CHECK(WaitFor([&] { return snapshot.IsLoaded(); }));
+    CHECK(!snapshot.LoadFailed());
+    CHECK(Percentage(snapshot, L"c:") == 40);
+    CHECK(Percentage(snapshot, L"D:") == 100);
+    CHECK(notifications > 0);
+
+    // A change event re-reads only the named volume.
+    int readsBefore = fake.reads;
+    fake.Set(MakeVolume(L"vol-c", L"C:", 55));
+    fake.Fire(MakeVolume(L"vol-c", L"C:", 0).path);
+    CHECK(WaitFor([&] { return Percentage(snapshot, L"C:") == 55; }));
+    CHECK(fake.reads == readsBefore + 1);
+
+    // Refreshes requested by the application itself, e.g. after setting a PIN.
+    VolumeStatus withPin = MakeVolume(L"vol-c", L"C:", 55);
+    withPin.protectorTypes.push_back(4);
+    fake.Set(withPin);
+    snapshot.RequestRefresh(withPin.path);
+    CHECK(WaitFor([&] { VolumeStatus s; return snapshot.Lookup(L"C:", s) && s.HasProtector(4); }));
+
+    snapshot.Stop();
+    CHECK(fake.closed);
+    int afterStop = notifications;
+    fake.Set(MakeVolume(L"vol-c", L"C:", 60));
+    snapshot.Apply(MakeVolume(L"vol-c", L"C:", 60));
+    CHECK(notifications == afterStop);
+}
+
+// Protector and progress changes raise no event; the slow timer picks them up.
+void TestFullRefresh()
+{
+    FakeVolumes fake;
+    fake.Set(MakeVolume(L"vol-c", L"C:", 10));
+    BitLockerStatusSnapshot snapshot(std::chrono::milliseconds(50));
+    snapshot.Start(std::unique_ptr<VolumeStatusSource>(new FakeVolumeSource(fake)), [] {});
+    CHECK(WaitFor([&] { return snapshot.IsLoaded(); }));
+    fake.Set(MakeVolume(L"vol-c", L"C:", 90));
+    CHECK(WaitFor([&] { return Percentage(snapshot, L"C:") == 90; }));
+    snapshot.Stop();
+}
+
+// Stop() must not wait for the whole first enumeration.
+void TestStopDuringEnumeration()
+{
+    FakeVolumes fake;
+    for (int i = 0; i < 200; ++i)
+        fake.Set(MakeVolume(L"vol-" + std::to_wstring(i), L"", 0));
+    fake.enumerateDelay = std::chrono::milliseconds(10);
+    BitLockerStatusSnapshot snapshot;
+    snapshot.Start(std::unique_ptr<VolumeStatusSource>(new FakeVolumeSource(fake)), [] {});
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto start = std::chrono::steady_clock::now();
+    snapshot.Stop();
+    auto stopMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    CHECK(stopMs < 200);
+    CHECK(fake.enumerated < 200);
+    CHECK(!snapshot.IsLoaded());
+    CHECK(fake.closed);
+}
+
+void TestFailures()
+{
+    FakeVolumes failing;
+    failing.openFails = true;
+    BitLockerStatusSnapshot failed;
+    failed.Start(std::unique_ptr<VolumeStatusSource>(new FakeVolumeSource(failing)), [] {});
+    CHECK(WaitFor([&] { return failed.LoadFailed(); }));
+    failed.Stop();
+
+    // Without events the snapshot still loads and refreshes on the timer.
+    FakeVolumes noEvents;
+    noEvents.subscribeFails = true;
+    noEvents.Set(MakeVolume(L"vol-c", L"C:", 1));
+    BitLockerStatusSnapshot snapshot(std::chrono::milliseconds(50));
+    snapshot.Start(std::unique_ptr<VolumeStatusSource>(new FakeVolumeSource(noEvents)), [] {});
+    CHECK(WaitFor([&] { return snapshot.IsLoaded(); }));
+    noEvents.Set(MakeVolume(L"vol-c", L"C:", 2));
+    CHECK(WaitFor([&] { return Percentage(snapshot, L"C:") == 2; }));
+    snapshot.Stop();
+}
+
+int main()
+{
+    TestLoadAndEvents();
+    TestFullRefresh();
+    TestStopDuringEnumeration();
+    TestFailures();
+    return TestResult();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Checks shared by the tests. CHECK reports a failed condition and carries on, so
+// one run lists every failure; TestResult() prints the verdict for main to return.
+
+#include <cstdio>
+
+inline int g_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++g_failures; \
+        } \
+    } while (0)
+
+inline int TestResult() {
+    printf(g_failures ? "FAIL (%d)\n" : "PASS\n", g_failures);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,214 @@
+// Concurrency stress test for LaunchCoalescer. Windows only: it exercises named
+// kernel objects shared by real processes.
+//
+//   cl /std:c++17 /EHsc /I.. LaunchCoalescerStressTest.cpp
+//   LaunchCoalescerStressTest.exe [workers]
+//
+// Starts copies of itself that join the same launch key at the same moment.
+// Exactly one must lead; it launches a sleeper copy of this program and every
+// other worker must report the sleeper's PID. The leader must not wait out the
+// dedup window. A second, smaller wave arriving after the first wave has exited
+// must still coalesce with the running sleeper, and a third wave after the
+// sleeper has exited must elect a new leader.
+
+#include "LaunchCoalescer.h"
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+void LogMessage(const std::wstring&) {}
+void PrintError(const TCHAR* msg) { _ftprintf(stderr, _T("%s (error %lu)\n"), msg, GetLastError()); }
+
+const DWORD WINDOW_MS = 20000;
+const DWORD SLEEPER_MS = 4000;
+const DWORD MAX_WORKERS = 256;
+
+enum WorkerRole : LONG { RoleNone = 0, RoleLeader = 1, RoleFollower = 2, RoleIndependent = 3 };
+
+struct WorkerResult {
+    LONG role;
+    DWORD processId;                // Launched (or coalesced) process.
+    DWORD elapsedMs;                // Join to destruction of the coalescer.
+};
+
+struct StressShared {
+    WorkerResult results[MAX_WORKERS];
+};
+
+std::wstring SharedName(DWORD parentId, const wchar_t* suffix) {
+    return L"Local\\LaunchCoalescerStress." + std::to_wstring(parentId) + suffix;
+}
+
+std::wstring ModulePath() {
+    WCHAR path[MAX_PATH];
+    GetModuleFileNameW(nullptr, path, MAX_PATH);
+    return path;
+}
+
+HANDLE Spawn(const std::wstring& arguments) {
+    std::wstring commandLine = L"\"" + ModulePath() + L"\" " + arguments;
+    STARTUPINFOW si = {};
+    si.cb = sizeof(si);
+    PROCESS_INFORMATION pi = {};
+    if (!CreateProcessW(nullptr, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi))
+        return nullptr;
+    CloseHandle(pi.hThread);
+    return pi.hProcess;
+}
+
+int RunWorker(DWORD parentId, DWORD index) {
+    HandleWrapper hSection(OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, SharedName(parentId, L"").c_str()));
+    HandleWrapper hGo(OpenEventW(SYNCHRONIZE, FALSE, SharedName(parentId, L".Go").c_str()));
+    if (!hSection.get() || !hGo.get() || index >= MAX_WORKERS)
+        return 2;
+    StressShared* shared = static_cast<StressShared*>(MapViewOfFile(hSection.get(),
+        FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(StressShared)));
+    if (!shared)
+        return 2;
+    WaitForSingleObject(hGo.get(), INFINITE);
+
+    WorkerResult result = {};
+    ULONGLONG start = GetTickCount64();
+    {
+        LaunchCoalescer coalescer(L"Local\\");
+        std::wstring key = L"stress-test-launch " + std::to_wstring(parentId);
+        LaunchCoalescer::Role role = coalescer.Join(1, key, WINDOW_MS);
+        if (role == LaunchCoalescer::Role::Leader) {
+            result.role = RoleLeader;
+            STARTUPINFOW si = {};
+            si.cb = sizeof(si);
+            PROCESS_INFORMATION pi = {};
+            std::wstring commandLine = L"\"" + ModulePath() + L"\" sleeper";
+            if (!CreateProcessW(nullptr, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi)) {
+                coalescer.Publish(nullptr, 0, 0, GetLastError());
+            }
+            else {
+                FILETIME creation = {}, exitTime, kernel, user;
+                GetProcessTimes(pi.hProcess, &creation, &exitTime, &kernel, &user);
+                coalescer.Publish(pi.hProcess, pi.dwProcessId, LaunchCoalescer::FileTimeToULongLong(creation), ERROR_SUCCESS);
+                result.processId = pi.dwProcessId;
+                CloseHandle(pi.hThread);
+                CloseHandle(pi.hProcess);
+            }
+        }
+        else if (role == LaunchCoalescer::Role::Follower) {
+            result.role = RoleFollower;
+            result.processId = coalescer.ProcessId();
+        }
+        else {
+            result.role = RoleIndependent;
+        }
+    }
+    result.elapsedMs = static_cast<DWORD>(GetTickCount64() - start);
+    shared->results[index] = result;
+    UnmapViewOfFile(shared);
+    return 0;
+}
+
+// Runs one wave of workers and checks its outcome. Returns the PID every worker
+// reported, or 0 on failure.
+DWORD RunWave(const char* name, StressShared* shared, HANDLE hGo, DWORD workers, bool expectLeader, DWORD expectedPid) {
+    ZeroMemory(shared, sizeof(StressShared));
+    ResetEvent(hGo);
+    std::vector<HANDLE> processes;
+    for (DWORD i = 0; i < workers; ++i) {
+        HANDLE hProcess = Spawn(L"worker " + std::to_wstring(GetCurrentProcessId()) + L" " + std::to_wstring(i));
+        if (!hProcess) {
+            printf("%s: could not start worker %lu\n", name, i);
+            return 0;
+        }
+        processes.push_back(hProcess);
+    }
+    SetEvent(hGo);
+    bool exitedCleanly = true;
+    for (HANDLE hProcess : processes) {
+        DWORD exitCode = 1;
+        WaitForSingleObject(hProcess, INFINITE);
+        GetExitCodeProcess(hProcess, &exitCode);
+        exitedCleanly = exitedCleanly && exitCode == 0;
+        CloseHandle(hProcess);
+    }
+
+    DWORD leaders = 0, followers = 0, others = 0, leaderElapsed = 0;
+    DWORD pid = 0;
+    bool samePid = true;
+    for (DWORD i = 0; i < workers; ++i) {
+        const WorkerResult& r = shared->results[i];
+        if (r.role == RoleLeader) {
+            ++leaders;
+            leaderElapsed = r.elapsedMs;
+        }
+        else if (r.role == RoleFollower) {
+            ++followers;
+        }
+        else {
+            ++others;
+        }
+        if (pid == 0)
+            pid = r.processId;
+        samePid = samePid && r.processId != 0 && r.processId == pid;
+    }
+    printf("%s: %lu workers, %lu leader, %lu followers, %lu other, PID %lu, leader took %lu ms\n",
+        name, workers, leaders, followers, others, pid, leaderElapsed);
+
+    bool ok = exitedCleanly && others == 0 && samePid &&
+        leaders == (expectLeader ? 1u : 0u) &&
+        (expectLeader ? leaderElapsed < WINDOW_MS / 4 : pid == expectedPid);
+    return ok ? pid : 0;
+}
+
+int _tmain(int argc, TCHAR* argv[])
+{
+    if (argc >= 2 && _tcscmp(argv[1], _T("sleeper")) == 0) {
+        Sleep(SLEEPER_MS);
+        return 0;
+    }
+    if (argc >= 4 && _tcscmp(argv[1], _T("worker")) == 0)
+        return RunWorker(_tcstoul(argv[2], nullptr, 10), _tcstoul(argv[3], nullptr, 10));
+
+    DWORD workers = argc >= 2 ? _tcstoul(argv[1], nullptr, 10) : 32;
+    if (workers < 2 || workers > MAX_WORKERS)
+        workers = 32;
+
+    DWORD self = GetCurrentProcessId();
+    HandleWrapper hSection(CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        0, sizeof(StressShared), SharedName(self, L"").c_str()));
+    HandleWrapper hGo(CreateEventW(nullptr, TRUE, FALSE, SharedName(self, L".Go").c_str()));
+    StressShared* shared = hSection.get()
+        ? static_cast<StressShared*>(MapViewOfFile(hSection.get(), FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(StressShared)))
+        : nullptr;
+    if (!shared || !hGo.get()) {
+        printf("Could not create the shared test objects.\n");
+        return 1;
+    }
+
+    // Wave 1: everyone at once; one leader launches the sleeper.
+    DWORD sleeperPid = RunWave("wave 1", shared, hGo.get(), workers, true, 0);
+    HandleWrapper hSleeper(sleeperPid ? OpenProcess(SYNCHRONIZE, FALSE, sleeperPid) : nullptr);
+    if (!sleeperPid || !hSleeper.get()) {
+        printf("FAIL\n");
+        return 1;
+    }
+
+    // Wave 2: the first wave has exited, but the sleeper holds the record.
+    if (WaitForSingleObject(hSleeper.get(), 0) != WAIT_TIMEOUT ||
+        !RunWave("wave 2", shared, hGo.get(), 4, false, sleeperPid)) {
+        printf("FAIL\n");
+        return 1;
+    }
+
+    // Wave 3: the sleeper is gone, so the launch must happen again.
+    WaitForSingleObject(hSleeper.get(), INFINITE);
+    DWORD relaunchedPid = RunWave("wave 3", shared, hGo.get(), workers, true, 0);
+    if (!relaunchedPid) {
+        printf("FAIL\n");
+        return 1;
+    }
+    HandleWrapper hRelaunched(OpenProcess(SYNCHRONIZE, FALSE, relaunchedPid));
+    if (hRelaunched.get())
+        WaitForSingleObject(hRelaunched.get(), INFINITE);
+
+    UnmapViewOfFile(shared);
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,227 @@
+// Concurrency stress test for the coalescing core (CoalescedLaunch.h), with
+// threads standing in for ServiceUIClone processes and a std::mutex per key for
+// the named mutex. Builds anywhere:
+//
+//   g++ -std=c++17 -O2 -pthread -I.. LaunchCoalescingStressTest.cpp -o LaunchCoalescingStressTest
+//   cl /std:c++17 /O2 /EHsc /I.. LaunchCoalescingStressTest.cpp
+//
+// tests/LaunchCoalescerStressTest.cpp runs the same kind of waves through the
+// Windows kernel objects with real processes.
+
+#include "CoalescedLaunch.h"
+#include "Check.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const uint64_t WINDOW_MS = 60000;
+const uint32_t MAX_PROCESSES = 1 << 16;
+
+// Launched "processes": alive while their slot holds their creation time.
+std::atomic<uint32_t> g_nextProcessId{ 1 };
+std::atomic<uint64_t> g_alive[MAX_PROCESSES];
+
+bool IsAlive(uint32_t processId, uint64_t creationTime) {
+    return processId < MAX_PROCESSES && g_alive[processId].load() == creationTime;
+}
+
+void Kill(uint32_t processId) {
+    if (processId && processId < MAX_PROCESSES)
+        g_alive[processId].store(0);
+}
+
+uint64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// One (session, command line) key: its lock and its shared record.
+struct Key {
+    std::mutex mutex;
+    CoalescedLaunch record = {};
+};
+
+struct JoinResult {
+    LaunchCoalescing::Role role;
+    uint32_t processId;
+    uint64_t creationTime;
+    uint32_t error;
+};
+
+// What LaunchCoalescer does for one launcher. The leader holds the key's lock
+// while it "launches" (launchMs) and until it publishes.
+JoinResult JoinOnce(Key& key, const std::wstring& commandLine, std::chrono::milliseconds launchMs,
+    uint32_t launchError = 0) {
+    key.mutex.lock();
+    CoalescedOutcome outcome;
+    LaunchCoalescing::Role role = LaunchCoalescing::Join(key.record, 1, commandLine, NowMs(), WINDOW_MS,
+        IsAlive, outcome);
+    if (role != LaunchCoalescing::Role::Leader) {
+        key.mutex.unlock();
+        return { role, outcome.processId, outcome.creationTime, outcome.error };
+    }
+    std::this_thread::sleep_for(launchMs);
+    uint32_t processId = 0;
+    uint64_t creationTime = 0;
+    if (!launchError) {
+        processId = g_nextProcessId++ % MAX_PROCESSES;
+        creationTime = NowMs() * 1000 + processId;
+        g_alive[processId].store(creationTime);
+    }
+    LaunchCoalescing::Publish(key.record, processId, creationTime, launchError, NowMs());
+    key.mutex.unlock();
+    return { role, processId, creationTime, launchError };
+}
+
+// Starts count threads that call work(i) at the same moment and waits for them.
+template <typename Work>
+void RunTogether(int count, Work work) {
+    std::mutex mutex;
+    std::condition_variable start;
+    bool go = false;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < count; ++i) {
+        threads.emplace_back([&, i] {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start.wait(lock, [&] { return go; });
+            }
+            work(i);
+        });
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        go = true;
+    }
+    start.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+// Waves of simultaneous duplicates: exactly one leads and everyone reports its
+// PID. While the launched process runs, a later wave coalesces with it; once it
+// has exited, the next wave elects a new leader.
+void TestWaves() {
+    const int WORKERS = 32;
+    const int WAVES = 200;
+    Key key;
+    uint32_t running = 0;
+    int badWaves = 0;
+    for (int wave = 0; wave < WAVES; ++wave) {
+        bool expectLeader = wave % 2 == 0;
+        if (expectLeader)
+            Kill(running);
+        std::vector<JoinResult> results(WORKERS);
+        RunTogether(WORKERS, [&](int i) {
+            results[i] = JoinOnce(key, L"notepad.exe", std::chrono::milliseconds(1));
+        });
+        int leaders = 0, followers = 0;
+        bool samePid = true;
+        for (const JoinResult& r : results) {
+            leaders += r.role == LaunchCoalescing::Role::Leader;
+            followers += r.role == LaunchCoalescing::Role::Follower;
+            samePid = samePid && r.processId != 0 && r.processId == results[0].processId;
+        }
+        bool ok = samePid && leaders + followers == WORKERS && leaders == (expectLeader ? 1 : 0) &&
+            (expectLeader || results[0].processId == running);
+        badWaves += !ok;
+        running = results[0].processId;
+    }
+    CHECK(badWaves == 0);
+}
+
+// Each key has its own lock: a slow launch must not hold up another key.
+void TestUnrelatedKeys() {
+    Key slow, fast;
+    std::atomic<bool> slowLeading{ false };
+    uint64_t fastMs = 0;
+    RunTogether(2, [&](int i) {
+        if (i == 0) {
+            slowLeading = true;
+            JoinOnce(slow, L"slow.exe", std::chrono::milliseconds(300));
+        }
+        else {
+            while (!slowLeading)
+                std::this_thread::yield();
+            uint64_t start = NowMs();
+            JoinOnce(fast, L"fast.exe", std::chrono::milliseconds(0));
+            fastMs = NowMs() - start;
+        }
+    });
+    CHECK(fastMs < 150);
+}
+
+// Followers report the outcome they saw under the lock, even when new leaders
+// reset the record right after: no follower may see PID 0 or a mismatched pair.
+void TestOutcomeCopy() {
+    const int WORKERS = 16;
+    const int ROUNDS = 2000;
+    Key key;
+    std::atomic<int> badFollowers{ 0 };
+    std::atomic<int> leaders{ 0 };
+    std::atomic<int> followers{ 0 };
+    RunTogether(WORKERS, [&](int) {
+        for (int round = 0; round < ROUNDS; ++round) {
+            JoinResult r = JoinOnce(key, L"churn.exe", std::chrono::milliseconds(0));
+            if (r.role == LaunchCoalescing::Role::Leader) {
+                ++leaders;
+            }
+            else {
+                ++followers;
+                if (r.processId == 0 || r.creationTime % 1000 != r.processId % 1000)
+                    ++badFollowers;
+            }
+            if (round % 4 == 0)
+                Kill(r.processId);              // The next launcher leads again.
+        }
+    });
+    CHECK(leaders > ROUNDS / 4);
+    CHECK(followers > 0);
+    CHECK(badFollowers == 0);
+}
+
+void TestOutcomes() {
+    // A failed launch is reported to duplicates within the window.
+    Key failed;
+    JoinResult leader = JoinOnce(failed, L"missing.exe", std::chrono::milliseconds(0), 2);
+    JoinResult follower = JoinOnce(failed, L"missing.exe", std::chrono::milliseconds(0));
+    CHECK(leader.role == LaunchCoalescing::Role::Leader);
+    CHECK(follower.role == LaunchCoalescing::Role::Follower);
+    CHECK(follower.error == 2);
+
+    // A leader that died before publishing leaves the record Pending.
+    Key abandoned;
+    CoalescedOutcome outcome;
+    LaunchCoalescing::Join(abandoned.record, 1, L"app.exe", NowMs(), WINDOW_MS, IsAlive, outcome);
+    CHECK(JoinOnce(abandoned, L"app.exe", std::chrono::milliseconds(0)).role == LaunchCoalescing::Role::Leader);
+
+    // Exit codes reach followers only while the record describes their launch.
+    Key exited;
+    leader = JoinOnce(exited, L"tool.exe", std::chrono::milliseconds(0));
+    follower = JoinOnce(exited, L"tool.exe", std::chrono::milliseconds(0));
+    CoalescedOutcome seen;
+    seen.state = LaunchSucceeded;
+    seen.processId = follower.processId;
+    seen.creationTime = follower.creationTime;
+    uint32_t exitCode = 0;
+    CHECK(!LaunchCoalescing::ExitCode(exited.record, seen, exitCode));
+    LaunchCoalescing::PublishExit(exited.record, leader.processId, leader.creationTime, 7);
+    CHECK(LaunchCoalescing::ExitCode(exited.record, seen, exitCode) && exitCode == 7);
+    Kill(leader.processId);
+    JoinOnce(exited, L"tool.exe", std::chrono::milliseconds(0));
+    CHECK(!LaunchCoalescing::ExitCode(exited.record, seen, exitCode));
+
+    // A different command line under the same key is a hash collision.
+    CHECK(JoinOnce(exited, L"other.exe", std::chrono::milliseconds(0)).role == LaunchCoalescing::Role::Independent);
+}
+
+int main() {
+    TestWaves();
+    TestUnrelatedKeys();
+    TestOutcomeCopy();
+    TestOutcomes();
+    return TestResult();
+}
@@ -0,0 +1,146 @@
+// Tests for the launch context cache core, driven by a fake source instead of
+// WTS, the user token and the registry: hits, invalidation on a new logon and on
+// an environment change, eviction and the hit-rate counters. Builds anywhere:
+//
+//   g++ -std=c++17 -O2 -I.. LaunchContextCacheTest.cpp -o LaunchContextCacheTest
+//   cl /std:c++17 /O2 /EHsc /I.. LaunchContextCacheTest.cpp
+
+#include "LaunchContextCache.h"
+#include "Check.h"
+#include <map>
+#include <memory>
+
+// Sessions and environment stamps held in memory; counts the expensive builds.
+class FakeLaunchContextSource : public LaunchContextSource {
+public:
+    std::map<uint32_t, uint64_t> logonTimes;
+    std::map<std::wstring, uint64_t> stamps;    // By user SID.
+    size_t environmentSize = 64;
+    int builds = 0;
+
+    bool LogonTime(uint32_t sessionId, uint64_t& logonTime) override {
+        auto it = logonTimes.find(sessionId);
+        if (it == logonTimes.end())
+            return false;
+        logonTime = it->second;
+        return true;
+    }
+
+    uint64_t EnvironmentStamp(const std::wstring& userSid) override {
+        return stamps[userSid];
+    }
+
+    bool Build(uint32_t sessionId, LaunchContext& context) override {
+        ++builds;
+        context.userSid = L"S-1-5-21-" + std::to_wstring(sessionId);
+        context.environmentStamp = stamps[context.userSid];
+        std::wstring variable = L"BUILD=" + std::to_wstring(builds);
+        context.environment = variable + std::wstring(1, L'\0');
+        context.environment.resize(environmentSize - 1, L'x');
+        context.environment += L'\0';
+        context.profileDirectory = L"C:\\Users\\user" + std::to_wstring(sessionId);
+        return true;
+    }
+};
+
+// What ServiceUIClone does for each launch, without the locking.
+LaunchContext Get(LaunchContextCacheState& state, FakeLaunchContextSource& source, uint32_t sessionId) {
+    LaunchContext context;
+    uint64_t logonTime = 0;
+    source.LogonTime(sessionId, logonTime);
+    if (!LaunchContextCache::Lookup(state, source, sessionId, logonTime, context)) {
+        source.Build(sessionId, context);
+        LaunchContextCache::Store(state, sessionId, logonTime, context);
+    }
+    return context;
+}
+
+std::unique_ptr<LaunchContextCacheState> NewState() {
+    return std::unique_ptr<LaunchContextCacheState>(new LaunchContextCacheState());
+}
+
+void TestHit() {
+    auto state = NewState();
+    FakeLaunchContextSource source;
+    source.logonTimes[1] = 100;
+    LaunchContext first = Get(*state, source, 1);
+    LaunchContext second = Get(*state, source, 1);
+    CHECK(source.builds == 1);
+    CHECK(second.environment == first.environment);
+    CHECK(second.environment.size() == 64);
+    CHECK(second.profileDirectory == L"C:\\Users\\user1");
+    CHECK(state->hits == 1);
+    CHECK(state->misses == 1);
+    CHECK(LaunchContextCache::HitRate(*state) == 0.5);
+}
+
+// A new logon into the same session must not see the previous user's context.
+void TestNewLogon() {
+    auto state = NewState();
+    FakeLaunchContextSource source;
+    source.logonTimes[1] = 100;
+    Get(*state, source, 1);
+    source.logonTimes[1] = 200;
+    LaunchContext context = Get(*state, source, 1);
+    CHECK(source.builds == 2);
+    CHECK(context.environment.compare(0, 7, L"BUILD=2") == 0);
+    Get(*state, source, 1);
+    CHECK(source.builds == 2);
+
+    int entries = 0;
+    for (const auto& entry : state->entries)
+        entries += entry.used && entry.sessionId == 1;
+    CHECK(entries == 1);
+}
+
+void TestEnvironmentChange() {
+    auto state = NewState();
+    FakeLaunchContextSource source;
+    source.logonTimes[1] = 100;
+    Get(*state, source, 1);
+    source.stamps[L"S-1-5-21-1"] = 7;
+    Get(*state, source, 1);
+    CHECK(source.builds == 2);
+    CHECK(state->invalidations == 1);
+    Get(*state, source, 1);
+    CHECK(source.builds == 2);
+    CHECK(state->hits == 1);
+}
+
+// The least recently used session is evicted when every entry is taken.
+void TestEviction() {
+    auto state = NewState();
+    FakeLaunchContextSource source;
+    for (uint32_t session = 1; session <= LAUNCH_CONTEXT_CACHE_ENTRIES + 1; ++session)
+        source.logonTimes[session] = 100 + session;
+    for (uint32_t session = 1; session <= LAUNCH_CONTEXT_CACHE_ENTRIES; ++session)
+        Get(*state, source, session);
+    Get(*state, source, 1);                     // Session 2 is now the oldest.
+    Get(*state, source, LAUNCH_CONTEXT_CACHE_ENTRIES + 1);
+    int builds = source.builds;
+    Get(*state, source, 1);
+    CHECK(source.builds == builds);
+    Get(*state, source, 2);
+    CHECK(source.builds == builds + 1);
+}
+
+void TestTooLarge() {
+    auto state = NewState();
+    FakeLaunchContextSource source;
+    source.logonTimes[1] = 100;
+    source.environmentSize = LAUNCH_CONTEXT_ENVIRONMENT_LENGTH + 1;
+    LaunchContext context = Get(*state, source, 1);
+    CHECK(context.environment.size() == LAUNCH_CONTEXT_ENVIRONMENT_LENGTH + 1);
+    Get(*state, source, 1);
+    CHECK(source.builds == 2);
+    CHECK(state->hits == 0);
+}
+
+int main() {
+    TestHit();
+    TestNewLogon();
+    TestEnvironmentChange();
+    TestEviction();
+    TestTooLarge();
+    return TestResult();
+}
@@ -0,0 +1,136 @@
+// Compares the startup cost of the standard and minimal-startup ServiceUIClone
+// builds from the outside, so neither build measures itself. Windows only.
+//
+//   cl /std:c++17 /O2 /EHsc StartupBench.cpp
+//   StartupBench.exe <standard.exe> <minimal.exe> [runs]
+//
+// Each build is started with no arguments, which takes the usage-error path:
+// the process starts, prints the usage line and exits without launching
+// anything. The runs alternate between the two builds so that both see the same
+// machine state. After each exit the creation-to-exit time and CPU time come
+// from GetProcessTimes and the peak working set from GetProcessMemoryInfo.
+// One untimed run of each build warms the file cache first.
+
+#include <windows.h>
+#include <psapi.h>
+#include <tchar.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#pragma comment(lib, "psapi.lib")
+
+const int DEFAULT_RUNS = 50;
+
+struct RunResult {
+    double elapsedMs;               // Creation to exit.
+    double cpuMs;                   // Kernel + user.
+    double peakWorkingSetKB;
+};
+
+ULONGLONG FileTimeToULongLong(const FILETIME& ft) {
+    ULARGE_INTEGER value;
+    value.LowPart = ft.dwLowDateTime;
+    value.HighPart = ft.dwHighDateTime;
+    return value.QuadPart;
+}
+
+// Starts path with no arguments, output discarded, and waits for it to exit.
+bool RunOnce(const std::wstring& path, HANDLE nul, RunResult& result) {
+    std::wstring commandLine = L"\"" + path + L"\"";
+    STARTUPINFOW si = { sizeof(si) };
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = nul;
+    si.hStdOutput = nul;
+    si.hStdError = nul;
+    PROCESS_INFORMATION pi = {};
+    if (!CreateProcessW(path.c_str(), &commandLine[0], nullptr, nullptr, TRUE,
+        CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi)) {
+        fwprintf(stderr, L"Starting %ls failed (error %lu)\n", path.c_str(), GetLastError());
+        return false;
+    }
+    CloseHandle(pi.hThread);
+    WaitForSingleObject(pi.hProcess, INFINITE);
+
+    FILETIME creation, exitTime, kernel, user;
+    PROCESS_MEMORY_COUNTERS counters = {};
+    counters.cb = sizeof(counters);
+    bool ok = GetProcessTimes(pi.hProcess, &creation, &exitTime, &kernel, &user) &&
+        GetProcessMemoryInfo(pi.hProcess, &counters, sizeof(counters));
+    CloseHandle(pi.hProcess);
+    if (!ok) {
+        fwprintf(stderr, L"Reading the statistics of %ls failed (error %lu)\n", path.c_str(), GetLastError());
+        return false;
+    }
+    result.elapsedMs = (FileTimeToULongLong(exitTime) - FileTimeToULongLong(creation)) / 10000.0;
+    result.cpuMs = (FileTimeToULongLong(kernel) + FileTimeToULongLong(user)) / 10000.0;
+    result.peakWorkingSetKB = counters.PeakWorkingSetSize / 1024.0;
+    return true;
+}
+
+void PrintStat(const wchar_t* name, std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (double v : values)
+        sum += v;
+    size_t n = values.size();
+    double median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+    wprintf(L"  %-18ls min %10.2f  median %10.2f  mean %10.2f\n", name, values.front(), median, sum / n);
+}
+
+void PrintResults(const wchar_t* label, const std::vector<RunResult>& runs) {
+    std::vector<double> elapsed, cpu, peak;
+    for (const RunResult& r : runs) {
+        elapsed.push_back(r.elapsedMs);
+        cpu.push_back(r.cpuMs);
+        peak.push_back(r.peakWorkingSetKB);
+    }
+    wprintf(L"%ls (%zu runs)\n", label, runs.size());
+    PrintStat(L"start-to-exit ms", elapsed);
+    PrintStat(L"CPU ms", cpu);
+    PrintStat(L"peak working KB", peak);
+}
+
+int wmain(int argc, wchar_t* argv[]) {
+    if (argc < 3) {
+        fwprintf(stderr, L"Usage: StartupBench.exe <standard.exe> <minimal.exe> [runs]\n");
+        return 1;
+    }
+    int runs = argc > 3 ? _wtoi(argv[3]) : DEFAULT_RUNS;
+    if (runs < 1)
+        runs = DEFAULT_RUNS;
+
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+    HANDLE nul = CreateFileW(L"NUL", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        &sa, OPEN_EXISTING, 0, nullptr);
+    if (nul == INVALID_HANDLE_VALUE) {
+        fwprintf(stderr, L"Opening NUL failed (error %lu)\n", GetLastError());
+        return 1;
+    }
+
+    const std::wstring builds[2] = { argv[1], argv[2] };
+    std::vector<RunResult> results[2];
+    RunResult result;
+    for (int b = 0; b < 2; ++b) {
+        if (!RunOnce(builds[b], nul, result)) {
+            CloseHandle(nul);
+            return 1;
+        }
+    }
+    for (int i = 0; i < runs; ++i) {
+        for (int b = 0; b < 2; ++b) {
+            if (!RunOnce(builds[b], nul, result)) {
+                CloseHandle(nul);
+                return 1;
+            }
+            results[b].push_back(result);
+        }
+    }
+    CloseHandle(nul);
+
+    PrintResults(L"standard", results[0]);
+    PrintResults(L"minimal-startup", results[1]);
+    return 0;
+}